@@ -0,0 +1,44 @@
+#ifndef BINARY_H
+#define BINARY_H
+
+#define BINARY_MAGIC "KMEANSDF"
+#define BINARY_VERSION 4
+// the only element type written so far, the rows are doubles
+#define BINARY_DTYPE_FLOAT64 1
+// the rows start on a page boundary so they can be mapped and advised
+#define BINARY_ALIGNMENT 4096
+// bytes of rows assigned between two madvise calls when streaming
+#define STREAM_CHUNK_BYTES (16 << 20)
+
+// a binary dataset is this header, the dataset name and the feature names
+// as NUL terminated strings, padding up to dataOffset, and then numRows rows
+// of stride doubles, the layout of Dataframe.data. The size and modification
+// time of the text file it was parsed from and a fingerprint of the schema it
+// was parsed with tell if a cache is still valid, they are 0 for files
+// written with --write-binary. The columns of the file the features were
+// taken from are kept too, so a mapped dataframe matches a parsed one
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t numFeatures;
+    uint32_t stride;
+    uint32_t dtype;
+    uint64_t numRows;
+    uint64_t dataOffset;
+    uint64_t sourceSize;
+    int64_t sourceMtime; // nanoseconds
+    uint64_t schema;
+    uint32_t maxColumns;
+    uint32_t startColumn;
+    uint32_t endColumn;
+} BinaryHeader;
+
+int writeBinaryDataset(const Dataframe *df, const char *path, const char *source, uint64_t schema);
+int mapBinaryDataset(const char *path, const char *source, uint64_t schema, Dataframe *df);
+void streamDataset(Dataframe *df);
+
+int streamChunkRows(const Dataframe *df);
+void prefetchRows(const Dataframe *df, int begin, int count);
+void releaseRows(const Dataframe *df, int begin, int count);
+
+#endif
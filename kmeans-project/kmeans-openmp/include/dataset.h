@@ -1,6 +1,6 @@
 #ifndef DATASET_H
 #define DATASET_H
 
-Dataframe loadDataset(const char *datasetName);
+Dataframe loadDataset(const char *datasetName, const char *columns);
 
 #endif
@@ -0,0 +1,86 @@
+#ifndef DISTANCE_H
+#define DISTANCE_H
+
+// rows assigned at once, small enough for the transposed tile to stay in L1
+#define ASSIGN_BLOCK_ROWS 256
+// feature counts with their own kernel, wider rows use the generic one
+#define MAX_SPECIALIZED_FEATURES 16
+// from here on the distances are computed as a matrix product. Below a full
+// group of the microkernel, 4 centroids, it computes repeated centroids and
+// measured no faster than the direct kernels on 20 to 64 features
+#define GEMM_MIN_FEATURES (MAX_SPECIALIZED_FEATURES + 1)
+#define GEMM_MIN_CENTROIDS 4
+// fewest centroids scanned per pass over a block, a multiple of the gemm
+// microkernel width
+#define MIN_CENTROID_TILE 16
+// used when the cache sizes can't be detected
+#define DEFAULT_L1_CACHE_SIZE (32 * 1024)
+
+// finds the closest centroid of count (<= ASSIGN_BLOCK_ROWS) rows. The
+// centroids use the row layout of the dataframe and are scanned centroidTile
+// at a time, see centroidTileSize. scratch must hold
+// closestScratchSize(numFeatures, k) elements
+typedef void (*ClosestKernel)(
+    const double *rows,
+    int stride,
+    int count,
+    int numFeatures,
+    const double *centroids,
+    int k,
+    int centroidTile,
+    double *scratch,
+    int *closest
+);
+
+typedef void (*ClosestKernelF32)(
+    const float *rows,
+    int stride,
+    int count,
+    int numFeatures,
+    const float *centroids,
+    int k,
+    int centroidTile,
+    float *scratch,
+    int *closest
+);
+
+typedef void (*ClosestKernelI16)(
+    const int16_t *rows,
+    int stride,
+    int count,
+    int numFeatures,
+    const int16_t *centroids,
+    int k,
+    int centroidTile,
+    int32_t *scratch,
+    int *closest
+);
+
+static inline int useGemm(int numFeatures, int k) {
+    return numFeatures >= GEMM_MIN_FEATURES && k >= GEMM_MIN_CENTROIDS;
+}
+
+const char *isaName(Isa isa);
+int parseIsa(const char *name, Isa *isa);
+int isaSupported(Isa isa);
+Isa resolveIsa(Isa isa);
+
+void detectCacheSizes(void);
+size_t closestScratchSize(int numFeatures, int k);
+int centroidTileSize(int numFeatures, int stride, size_t elementSize, int k);
+ClosestKernel selectClosestKernel(int numFeatures, int k, Isa isa);
+ClosestKernelF32 selectClosestKernelF32(int numFeatures, int k, Isa isa);
+ClosestKernelI16 selectClosestKernelI16(int numFeatures, Isa isa);
+
+// the same kernels compiled for each instruction set, see distance_kernels.h
+ClosestKernel selectClosestKernelSse2(int numFeatures, int k);
+ClosestKernelF32 selectClosestKernelF32Sse2(int numFeatures, int k);
+ClosestKernelI16 selectClosestKernelI16Sse2(int numFeatures);
+ClosestKernel selectClosestKernelAvx2(int numFeatures, int k);
+ClosestKernelF32 selectClosestKernelF32Avx2(int numFeatures, int k);
+ClosestKernelI16 selectClosestKernelI16Avx2(int numFeatures);
+ClosestKernel selectClosestKernelAvx512(int numFeatures, int k);
+ClosestKernelF32 selectClosestKernelF32Avx512(int numFeatures, int k);
+ClosestKernelI16 selectClosestKernelI16Avx512(int numFeatures);
+
+#endif
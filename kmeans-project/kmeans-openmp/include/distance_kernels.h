@@ -0,0 +1,357 @@
+/*
+Body of the assignment kernels, included once by every distance_<isa>.c file
+so the same kernels are compiled for each instruction set. There's no include
+guard on purpose.
+
+The including file compiles for its instruction set with #pragma GCC target
+and defines, for SUF in F64 and F32:
+
+   ISA_NAME(name)        name of an exported function, e.g. name##Avx2
+   VEC_SUF, LANES_SUF    vector type and number of lanes
+   MASK_SUF              result of a comparison
+   LOAD_SUF(p)           unaligned load
+   STORE_SUF(p, v)       unaligned store
+   SET1_SUF(x)           broadcast
+   SUB_SUF(a, b)         a - b
+   FMA_SUF(a, b, c)      a * b + c
+   LESS_SUF(a, b)        a < b per lane
+   BLEND_SUF(m, a, b)    b where m is set, a elsewhere
+
+and the same for SUF = I32 (int32 lanes) plus:
+
+   SUB_I16(a, b)         a - b on the int16 halves
+   MADD_I16(a, b)        a * b on the int16 halves, adjacent products added
+*/
+
+// the kernel keeps the best distance and centroid of LANES points in
+// registers while it scans a tile of centroids, the centroid index is tracked
+// as a TYPE vector so it can be blended with the same mask as the distance.
+// Between tiles the running minima go back to scratch, so each tile is read
+// from L1 by every vector of the block instead of the whole centroid table.
+// FEATURES is either a constant, which unrolls the feature loop, or the
+// numFeatures argument for the generic kernel
+#define DEFINE_CLOSEST_KERNEL(NAME, TYPE, SUF, FEATURES)                     \
+static void NAME(                                                            \
+    const TYPE *rows,                                                        \
+    int stride,                                                              \
+    int count,                                                               \
+    int numFeatures,                                                         \
+    const TYPE *centroids,                                                   \
+    int k,                                                                   \
+    int centroidTile,                                                        \
+    TYPE *scratch,                                                           \
+    int *closest                                                             \
+) {                                                                          \
+    (void)numFeatures;                                                       \
+    TYPE *tile = scratch;                                                    \
+    TYPE *index = scratch + (size_t)(FEATURES) * ASSIGN_BLOCK_ROWS;          \
+    TYPE *distance = index + ASSIGN_BLOCK_ROWS;                              \
+    /* the last vector is padded with zero rows, their results are dropped */ \
+    int padded = (count + LANES_##SUF - 1) / LANES_##SUF * LANES_##SUF;      \
+                                                                             \
+    for (int i = 0; i < padded; i++) {                                       \
+        for (int l = 0; l < (FEATURES); l++) {                               \
+            tile[l * ASSIGN_BLOCK_ROWS + i] = i < count ? rows[i * stride + l] : 0; \
+        }                                                                    \
+    }                                                                        \
+                                                                             \
+    for (int j0 = 0; j0 < k; j0 += centroidTile) {                           \
+        int j1 = j0 + centroidTile < k ? j0 + centroidTile : k;              \
+        for (int i0 = 0; i0 < padded; i0 += LANES_##SUF) {                   \
+            VEC_##SUF best = SET1_##SUF(INFINITY);                           \
+            VEC_##SUF bestIndex = SET1_##SUF(0);                             \
+            if (j0 > 0) {                                                    \
+                best = LOAD_##SUF(distance + i0);                            \
+                bestIndex = LOAD_##SUF(index + i0);                          \
+            }                                                                \
+                                                                             \
+            for (int j = j0; j < j1; j++) {                                  \
+                const TYPE *centroid = centroids + (size_t)j * stride;       \
+                VEC_##SUF sum = SET1_##SUF(0);                               \
+                for (int l = 0; l < (FEATURES); l++) {                       \
+                    VEC_##SUF diff = SUB_##SUF(                              \
+                        LOAD_##SUF(tile + l * ASSIGN_BLOCK_ROWS + i0),       \
+                        SET1_##SUF(centroid[l])                              \
+                    );                                                       \
+                    sum = FMA_##SUF(diff, diff, sum);                        \
+                }                                                            \
+                /* strict comparison: ties go to the first centroid */       \
+                MASK_##SUF closer = LESS_##SUF(sum, best);                   \
+                best = BLEND_##SUF(closer, best, sum);                       \
+                bestIndex = BLEND_##SUF(closer, bestIndex, SET1_##SUF((TYPE)j)); \
+            }                                                                \
+                                                                             \
+            STORE_##SUF(distance + i0, best);                                \
+            STORE_##SUF(index + i0, bestIndex);                              \
+        }                                                                    \
+    }                                                                        \
+                                                                             \
+    for (int i = 0; i < count; i++) {                                        \
+        closest[i] = (int)index[i];                                          \
+    }                                                                        \
+}
+
+// same kernel on the int16 copy of the data. Each int32 lane holds two
+// adjacent features of one point, so the square of the difference is a
+// single madd that already adds the two features up. The quantization in
+// buildInt16Storage guarantees the int32 sums can't overflow
+#define DEFINE_CLOSEST_KERNEL_I16(NAME, FEATURES)                            \
+static void NAME(                                                            \
+    const int16_t *rows,                                                     \
+    int stride,                                                              \
+    int count,                                                               \
+    int numFeatures,                                                         \
+    const int16_t *centroids,                                                \
+    int k,                                                                   \
+    int centroidTile,                                                        \
+    int32_t *scratch,                                                        \
+    int *closest                                                             \
+) {                                                                          \
+    (void)numFeatures;                                                       \
+    const int pairs = ((FEATURES) + 1) / 2;                                  \
+    int32_t *tile = scratch;                                                 \
+    int32_t *index = scratch + (size_t)pairs * ASSIGN_BLOCK_ROWS;            \
+    int32_t *distance = index + ASSIGN_BLOCK_ROWS;                           \
+    int padded = (count + LANES_I32 - 1) / LANES_I32 * LANES_I32;            \
+                                                                             \
+    for (int i = 0; i < padded; i++) {                                       \
+        for (int p = 0; p < pairs; p++) {                                    \
+            int32_t pair = 0;                                                \
+            if (i < count) {                                                 \
+                memcpy(&pair, rows + i * stride + 2 * p, sizeof(pair));      \
+            }                                                                \
+            tile[p * ASSIGN_BLOCK_ROWS + i] = pair;                          \
+        }                                                                    \
+    }                                                                        \
+                                                                             \
+    for (int j0 = 0; j0 < k; j0 += centroidTile) {                           \
+        int j1 = j0 + centroidTile < k ? j0 + centroidTile : k;              \
+        for (int i0 = 0; i0 < padded; i0 += LANES_I32) {                     \
+            VEC_I32 best = SET1_I32(INT32_MAX);                              \
+            VEC_I32 bestIndex = SET1_I32(0);                                 \
+            if (j0 > 0) {                                                    \
+                best = LOAD_I32(distance + i0);                              \
+                bestIndex = LOAD_I32(index + i0);                            \
+            }                                                                \
+                                                                             \
+            for (int j = j0; j < j1; j++) {                                  \
+                const int16_t *centroid = centroids + (size_t)j * stride;    \
+                VEC_I32 sum = SET1_I32(0);                                   \
+                for (int p = 0; p < pairs; p++) {                            \
+                    int32_t pair;                                            \
+                    memcpy(&pair, centroid + 2 * p, sizeof(pair));           \
+                    VEC_I32 diff = SUB_I16(                                  \
+                        LOAD_I32(tile + p * ASSIGN_BLOCK_ROWS + i0),         \
+                        SET1_I32(pair)                                       \
+                    );                                                       \
+                    sum = ADD_I32(sum, MADD_I16(diff, diff));                \
+                }                                                            \
+                MASK_I32 closer = LESS_I32(sum, best);                       \
+                best = BLEND_I32(closer, best, sum);                         \
+                bestIndex = BLEND_I32(closer, bestIndex, SET1_I32(j));       \
+            }                                                                \
+                                                                             \
+            STORE_I32(distance + i0, best);                                  \
+            STORE_I32(index + i0, bestIndex);                                \
+        }                                                                    \
+    }                                                                        \
+                                                                             \
+    for (int i = 0; i < count; i++) {                                        \
+        closest[i] = index[i];                                               \
+    }                                                                        \
+}
+
+// the gemm microkernel computes the products of a panel of
+// GEMM_PANEL_VECTORS vectors of points with GEMM_CENTROIDS centroids at once,
+// 8 accumulators plus the two point vectors and a broadcast, so it fits the
+// 16 vector registers of SSE2 and AVX2
+#define GEMM_PANEL_VECTORS 2
+#define GEMM_CENTROIDS 4
+
+// |c|^2 - 2 x.c of centroid J from its accumulator, kept if it's closer.
+// Strict comparison: ties go to the first centroid
+#define GEMM_KEEP_CLOSER(TYPE, SUF, ACC, NORM, J, BEST, BEST_INDEX) do {     \
+    VEC_##SUF distance_ = FMA_##SUF(ACC, SET1_##SUF(-2), SET1_##SUF(NORM));  \
+    MASK_##SUF closer_ = LESS_##SUF(distance_, BEST);                        \
+    BEST = BLEND_##SUF(closer_, BEST, distance_);                            \
+    BEST_INDEX = BLEND_##SUF(closer_, BEST_INDEX, SET1_##SUF((TYPE)(J)));    \
+} while (0)
+
+// the panel of points stays in registers for a whole group of centroids:
+// every feature loads two vectors of points and four broadcasts, and does
+// eight fmas on accumulators that never leave the registers
+#define DEFINE_GEMM_KERNEL(NAME, TYPE, SUF)                                  \
+static void NAME(                                                            \
+    const TYPE *rows,                                                        \
+    int stride,                                                              \
+    int count,                                                               \
+    int numFeatures,                                                         \
+    const TYPE *centroids,                                                   \
+    int k,                                                                   \
+    int centroidTile,                                                        \
+    TYPE *scratch,                                                           \
+    int *closest                                                             \
+) {                                                                          \
+    const int panelRows = GEMM_PANEL_VECTORS * LANES_##SUF;                  \
+    TYPE *tile = scratch;                                                    \
+    TYPE *distance = scratch + (size_t)numFeatures * ASSIGN_BLOCK_ROWS;      \
+    TYPE *index = distance + ASSIGN_BLOCK_ROWS;                              \
+    TYPE *norms = index + ASSIGN_BLOCK_ROWS;                                 \
+    /* the last panel is padded with zero rows, their results are dropped */ \
+    int padded = (count + panelRows - 1) / panelRows * panelRows;            \
+                                                                             \
+    for (int i = 0; i < padded; i++) {                                       \
+        for (int l = 0; l < numFeatures; l++) {                              \
+            tile[l * ASSIGN_BLOCK_ROWS + i] = i < count ? rows[i * stride + l] : 0; \
+        }                                                                    \
+        distance[i] = INFINITY;                                              \
+        index[i] = 0;                                                        \
+    }                                                                        \
+                                                                             \
+    for (int j = 0; j < k; j++) {                                            \
+        const TYPE *centroid = centroids + (size_t)j * stride;               \
+        TYPE sum = 0;                                                        \
+        for (int l = 0; l < numFeatures; l++) {                              \
+            sum += centroid[l] * centroid[l];                                \
+        }                                                                    \
+        norms[j] = sum;                                                      \
+    }                                                                        \
+                                                                             \
+    /* centroidTile is a multiple of GEMM_CENTROIDS, so only the last */     \
+    /* group of the last tile can be short */                                \
+    for (int t0 = 0; t0 < k; t0 += centroidTile) {                           \
+        int t1 = t0 + centroidTile < k ? t0 + centroidTile : k;              \
+        for (int i0 = 0; i0 < padded; i0 += panelRows) {                     \
+            VEC_##SUF best0 = LOAD_##SUF(distance + i0);                     \
+            VEC_##SUF best1 = LOAD_##SUF(distance + i0 + LANES_##SUF);       \
+            VEC_##SUF bestIndex0 = LOAD_##SUF(index + i0);                   \
+            VEC_##SUF bestIndex1 = LOAD_##SUF(index + i0 + LANES_##SUF);     \
+                                                                             \
+            for (int j0 = t0; j0 < t1; j0 += GEMM_CENTROIDS) {               \
+                /* a short last group repeats the last centroid, the strict */ \
+                /* comparison never lets the copies win */                   \
+                int j1 = j0 + 1 < k ? j0 + 1 : k - 1;                        \
+                int j2 = j0 + 2 < k ? j0 + 2 : k - 1;                        \
+                int j3 = j0 + 3 < k ? j0 + 3 : k - 1;                        \
+                const TYPE *c0 = centroids + (size_t)j0 * stride;            \
+                const TYPE *c1 = centroids + (size_t)j1 * stride;            \
+                const TYPE *c2 = centroids + (size_t)j2 * stride;            \
+                const TYPE *c3 = centroids + (size_t)j3 * stride;            \
+                                                                             \
+                VEC_##SUF acc00 = SET1_##SUF(0), acc01 = SET1_##SUF(0);      \
+                VEC_##SUF acc10 = SET1_##SUF(0), acc11 = SET1_##SUF(0);      \
+                VEC_##SUF acc20 = SET1_##SUF(0), acc21 = SET1_##SUF(0);      \
+                VEC_##SUF acc30 = SET1_##SUF(0), acc31 = SET1_##SUF(0);      \
+                for (int l = 0; l < numFeatures; l++) {                      \
+                    const TYPE *x = tile + l * ASSIGN_BLOCK_ROWS + i0;       \
+                    VEC_##SUF x0 = LOAD_##SUF(x);                            \
+                    VEC_##SUF x1 = LOAD_##SUF(x + LANES_##SUF);              \
+                    VEC_##SUF c = SET1_##SUF(c0[l]);                         \
+                    acc00 = FMA_##SUF(x0, c, acc00);                         \
+                    acc01 = FMA_##SUF(x1, c, acc01);                         \
+                    c = SET1_##SUF(c1[l]);                                   \
+                    acc10 = FMA_##SUF(x0, c, acc10);                         \
+                    acc11 = FMA_##SUF(x1, c, acc11);                         \
+                    c = SET1_##SUF(c2[l]);                                   \
+                    acc20 = FMA_##SUF(x0, c, acc20);                         \
+                    acc21 = FMA_##SUF(x1, c, acc21);                         \
+                    c = SET1_##SUF(c3[l]);                                   \
+                    acc30 = FMA_##SUF(x0, c, acc30);                         \
+                    acc31 = FMA_##SUF(x1, c, acc31);                         \
+                }                                                            \
+                                                                             \
+                GEMM_KEEP_CLOSER(TYPE, SUF, acc00, norms[j0], j0, best0, bestIndex0); \
+                GEMM_KEEP_CLOSER(TYPE, SUF, acc01, norms[j0], j0, best1, bestIndex1); \
+                GEMM_KEEP_CLOSER(TYPE, SUF, acc10, norms[j1], j1, best0, bestIndex0); \
+                GEMM_KEEP_CLOSER(TYPE, SUF, acc11, norms[j1], j1, best1, bestIndex1); \
+                GEMM_KEEP_CLOSER(TYPE, SUF, acc20, norms[j2], j2, best0, bestIndex0); \
+                GEMM_KEEP_CLOSER(TYPE, SUF, acc21, norms[j2], j2, best1, bestIndex1); \
+                GEMM_KEEP_CLOSER(TYPE, SUF, acc30, norms[j3], j3, best0, bestIndex0); \
+                GEMM_KEEP_CLOSER(TYPE, SUF, acc31, norms[j3], j3, best1, bestIndex1); \
+            }                                                                \
+                                                                             \
+            STORE_##SUF(distance + i0, best0);                               \
+            STORE_##SUF(distance + i0 + LANES_##SUF, best1);                 \
+            STORE_##SUF(index + i0, bestIndex0);                             \
+            STORE_##SUF(index + i0 + LANES_##SUF, bestIndex1);               \
+        }                                                                    \
+    }                                                                        \
+                                                                             \
+    for (int i = 0; i < count; i++) {                                        \
+        closest[i] = (int)index[i];                                          \
+    }                                                                        \
+}
+
+#define DEFINE_KERNELS(D)                                   \
+    DEFINE_CLOSEST_KERNEL(closest##D, double, F64, D)       \
+    DEFINE_CLOSEST_KERNEL(closest##D##F32, float, F32, D)   \
+    DEFINE_CLOSEST_KERNEL_I16(closest##D##I16, D)
+
+DEFINE_KERNELS(2)
+DEFINE_KERNELS(3)
+DEFINE_KERNELS(4)
+DEFINE_KERNELS(5)
+DEFINE_KERNELS(6)
+DEFINE_KERNELS(7)
+DEFINE_KERNELS(8)
+DEFINE_KERNELS(9)
+DEFINE_KERNELS(10)
+DEFINE_KERNELS(11)
+DEFINE_KERNELS(12)
+DEFINE_KERNELS(13)
+DEFINE_KERNELS(14)
+DEFINE_KERNELS(15)
+DEFINE_KERNELS(16)
+
+DEFINE_CLOSEST_KERNEL(closestGeneric, double, F64, numFeatures)
+DEFINE_CLOSEST_KERNEL(closestGenericF32, float, F32, numFeatures)
+DEFINE_CLOSEST_KERNEL_I16(closestGenericI16, numFeatures)
+
+DEFINE_GEMM_KERNEL(closestGemm, double, F64)
+DEFINE_GEMM_KERNEL(closestGemmF32, float, F32)
+
+static const ClosestKernel kernels[MAX_SPECIALIZED_FEATURES + 1] = {
+    NULL, NULL, closest2, closest3, closest4, closest5, closest6, closest7,
+    closest8, closest9, closest10, closest11, closest12, closest13, closest14,
+    closest15, closest16
+};
+
+static const ClosestKernelF32 kernelsF32[MAX_SPECIALIZED_FEATURES + 1] = {
+    NULL, NULL, closest2F32, closest3F32, closest4F32, closest5F32, closest6F32,
+    closest7F32, closest8F32, closest9F32, closest10F32, closest11F32,
+    closest12F32, closest13F32, closest14F32, closest15F32, closest16F32
+};
+
+static const ClosestKernelI16 kernelsI16[MAX_SPECIALIZED_FEATURES + 1] = {
+    NULL, NULL, closest2I16, closest3I16, closest4I16, closest5I16, closest6I16,
+    closest7I16, closest8I16, closest9I16, closest10I16, closest11I16,
+    closest12I16, closest13I16, closest14I16, closest15I16, closest16I16
+};
+
+ClosestKernel ISA_NAME(selectClosestKernel)(int numFeatures, int k) {
+    if (useGemm(numFeatures, k)) {
+        return closestGemm;
+    }
+    if (numFeatures >= 2 && numFeatures <= MAX_SPECIALIZED_FEATURES) {
+        return kernels[numFeatures];
+    }
+    return closestGeneric;
+}
+
+ClosestKernelF32 ISA_NAME(selectClosestKernelF32)(int numFeatures, int k) {
+    if (useGemm(numFeatures, k)) {
+        return closestGemmF32;
+    }
+    if (numFeatures >= 2 && numFeatures <= MAX_SPECIALIZED_FEATURES) {
+        return kernelsF32[numFeatures];
+    }
+    return closestGenericF32;
+}
+
+// there's no matrix product variant, the expanded form would overflow int32
+ClosestKernelI16 ISA_NAME(selectClosestKernelI16)(int numFeatures) {
+    if (numFeatures >= 2 && numFeatures <= MAX_SPECIALIZED_FEATURES) {
+        return kernelsI16[numFeatures];
+    }
+    return closestGenericI16;
+}
@@ -0,0 +1,14 @@
+#ifndef ELKAN_H
+#define ELKAN_H
+
+void elkan(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    int maxIter,
+    Experiment *exp,
+    int debug,
+    Workspace *ws
+);
+
+#endif
@@ -2,8 +2,8 @@
 #define EXPERIMENTS_H
 
 void saveIterationData(
-    double **centroids,
-    int *assignments,
+    double *centroids,
+    Assignments assignments,
     Dataframe *df,
     int k,
     int iteration,
@@ -0,0 +1,14 @@
+#ifndef HAMERLY_H
+#define HAMERLY_H
+
+void hamerly(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    int maxIter,
+    Experiment *exp,
+    int debug,
+    Workspace *ws
+);
+
+#endif
@@ -1,24 +1,197 @@
 #ifndef HELPER_H
 #define HELPER_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+// every row buffer is aligned to a cache line
+#define DATA_ALIGNMENT 64
+// smallest block an arena maps, and the size of the huge pages it asks for
+#define ARENA_BLOCK_SIZE (1 << 20)
+#define HUGE_PAGE_SIZE (2 << 20)
+
+// a region of memory whose allocations are all released at once by
+// releaseArena, see helper.c. A zeroed arena is empty
+typedef struct ArenaBlock ArenaBlock;
+typedef struct {
+    ArenaBlock *blocks;
+} Arena;
+
 typedef struct {
     char *name;
-    double **data;
+    // rows are stored contiguously (row-major), row i starts at data + i * stride
+    double *data;
+    // optional single precision copy with the same layout, streamed by the
+    // assignment step in float precision, NULL unless built
+    float *dataF32;
     char **features; // list of features
     int maxRows;
     int maxColumns;
     int numFeatures;
     int startColumn;
     int endColumn;
+    int stride; // doubles per row, >= numFeatures, the padding is zeroed
+    // optional int16 copy of integer valued data, NULL unless built. Column l
+    // holds (x - offsetsI16[l]) >> shiftI16, so it's exact when the shift is 0
+    int16_t *dataI16;
+    double *offsetsI16;
+    int shiftI16;
+    int strideI16; // int16 per row, numFeatures rounded up to even
+    int *rowIds; // file row of every row, NULL if they're in file order
+    // binary file the rows are mapped from, NULL if they're in memory, see
+    // binary.c. The name and the feature names point into it too
+    void *mapping;
+    size_t mappedBytes;
+    int streamed; // mapped rows are paged in and dropped chunk by chunk
+    Arena arena; // holds the rows, their copies and the names unless mapped
 } Dataframe;
 
+// cluster of every row, stored in the narrowest unsigned type that holds k
+// clusters plus a "none yet" value, so small k moves a byte per row
+typedef struct {
+    int width; // bytes per entry: 1, 2 or 4
+    void *data; // NULL if the assignments aren't kept
+} Assignments;
+
+typedef enum {
+    ALGORITHM_LLOYD,
+    ALGORITHM_ELKAN,
+    ALGORITHM_HAMERLY,
+    ALGORITHM_YINYANG,
+    ALGORITHM_MINIBATCH,
+    ALGORITHM_KDTREE
+} Algorithm;
+
+typedef enum {
+    INIT_RANDOM,
+    INIT_KMEANS_PLUS_PLUS,
+    INIT_KMEANS_PARALLEL
+} Initialization;
+
+typedef enum {
+    PRECISION_DOUBLE,
+    PRECISION_FLOAT,
+    PRECISION_INT16
+} Precision;
+
+// instruction set of the assignment kernels
+typedef enum {
+    ISA_AUTO, // the widest one the cpu supports
+    ISA_SSE2,
+    ISA_AVX2,
+    ISA_AVX512
+} Isa;
+
+// how the threads are spread over the experiments of a run
+typedef enum {
+    SCHEDULE_AUTO, // picked from the work of one iteration, see schedule.c
+    SCHEDULE_DATA, // one experiment at a time, threads split the rows
+    SCHEDULE_EXPERIMENTS, // one thread per experiment
+    SCHEDULE_NESTED // teams of threads per experiment, splitting the rows
+} Schedule;
+
 typedef struct {
     int number;
     double executionTime;
     int convergenceIteration;
+    Algorithm algorithm;
+    Initialization init;
+    Precision precision;
+    Isa isa;
+    Schedule schedule;
+    long long distanceCount; // point-centroid distances evaluated
+    long long changedPoints; // cluster changes, summed over the iterations
+    double inertia; // sum of squared distances to the final centroids
 } Experiment;
 
-// Removed so vectorize with simd
-// double euclideanDistance(double *point1, double *point2, int numFeatures);
+static inline double *dfRow(const Dataframe *df, int i) {
+    return df->data + (size_t)i * df->stride;
+}
+
+static inline float *dfRowF32(const Dataframe *df, int i) {
+    return df->dataF32 + (size_t)i * df->stride;
+}
+
+static inline int16_t *dfRowI16(const Dataframe *df, int i) {
+    return df->dataI16 + (size_t)i * df->strideI16;
+}
+
+// the width is the same for every entry of a run, so the switches are
+// unswitched out of the callers' loops
+static inline int getAssignment(Assignments assignments, int i) {
+    switch (assignments.width) {
+        case 1: {
+            uint8_t cluster = ((const uint8_t *)assignments.data)[i];
+            return cluster == UINT8_MAX ? -1 : cluster;
+        }
+        case 2: {
+            uint16_t cluster = ((const uint16_t *)assignments.data)[i];
+            return cluster == UINT16_MAX ? -1 : cluster;
+        }
+        default:
+            return ((const int32_t *)assignments.data)[i];
+    }
+}
+
+static inline void setAssignment(Assignments assignments, int i, int cluster) {
+    switch (assignments.width) {
+        case 1:
+            ((uint8_t *)assignments.data)[i] = (uint8_t)cluster;
+            break;
+        case 2:
+            ((uint16_t *)assignments.data)[i] = (uint16_t)cluster;
+            break;
+        default:
+            ((int32_t *)assignments.data)[i] = cluster;
+            break;
+    }
+}
+
+void setHugePages(int enabled);
+void *arenaAlloc(Arena *arena, size_t size);
+void releaseArena(Arena *arena);
+int rowStride(int numFeatures);
+double *allocMatrix(int rows, int stride);
+Assignments allocAssignments(Arena *arena, int rows, int k);
+void buildFloatStorage(Dataframe *df);
+int buildInt16Storage(Dataframe *df);
+void freeDataframe(Dataframe *df);
+
+// splitmix64: tiny, fast and every caller owns its state, so it's thread safe
+static inline uint64_t nextRandom(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// uniform in [0, 1)
+static inline double nextUniform(uint64_t *state) {
+    return (nextRandom(state) >> 11) * 0x1.0p-53;
+}
+
+// static inline so the callers' loops still vectorize with simd
+static inline double squaredEuclideanDistance(
+    const double *point1,
+    const double *point2,
+    int numFeatures
+) {
+    double sum = 0.0;
+    #pragma omp simd reduction(+:sum)
+    for (int i = 0; i < numFeatures; i++) {
+        double diff = point1[i] - point2[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+static inline double euclideanDistance(
+    const double *point1,
+    const double *point2,
+    int numFeatures
+) {
+    return sqrt(squaredEuclideanDistance(point1, point2, numFeatures));
+}
 
 #endif
@@ -0,0 +1,42 @@
+#ifndef KDTREE_H
+#define KDTREE_H
+
+// most points a leaf holds
+#define KDTREE_LEAF_SIZE 256
+// nodes with fewer points are built by the thread that reached them
+#define KDTREE_TASK_ROWS 16384
+
+// nodes are stored as parallel arrays, node 0 is the root and every node owns
+// the tree rows [begin, end)
+typedef struct KdTree {
+    Arena arena; // holds the rows and the nodes, released at once by freeKdTree
+    int numNodes;
+    int capacity;
+    int depth; // of the deepest leaf, the root is at 0
+    int *perm; // dataframe row of every tree row
+    double *points; // the rows in tree order, with the dataframe stride
+    int *begin;
+    int *end;
+    int *left; // -1 for leaves
+    int *right;
+    double *lo; // bounding box of the points, capacity rows with the dataframe stride
+    double *hi;
+    double *sum; // sum of the points, so a whole cell can be assigned at once
+} KdTree;
+
+KdTree *buildKdTree(Dataframe *df);
+void freeKdTree(KdTree *tree);
+
+// the tree only reads the dataframe, so the experiments of a run share it
+void kdtreeFiltering(
+    Dataframe *df,
+    KdTree *tree,
+    double *centroids,
+    int k,
+    int maxIter,
+    Experiment *exp,
+    int debug,
+    Workspace *ws
+);
+
+#endif
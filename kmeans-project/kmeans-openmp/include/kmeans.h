@@ -1,13 +1,119 @@
 #ifndef KMEANS_H
 #define KMEANS_H
 
+#define CONVERGENCE_THRESHOLD 1e-6
+// delta sweeps between two full recomputations of the centroid sums
+#define DELTA_RESYNC_INTERVAL 10
+
+typedef struct {
+    Algorithm algorithm;
+    Initialization init;
+    Precision precision; // of the distances in the assignment step
+    Isa isa; // instruction set of the assignment kernels
+    Schedule schedule; // threads across experiments or across rows
+    uint64_t seed; // experiment i is seeded with seed + i
+    int batchSize; // rows sampled per mini-batch iteration
+    int maxNoImprovement; // mini-batches without inertia improvement before stopping
+    int reorderInterval; // lloyd sorts its rows by cluster every this many iterations, 0 never
+    struct KdTree *kdtree; // built once per dataset and shared by the kdtree experiments
+} KmeansConfig;
+
+#define DEFAULT_BATCH_SIZE 1024
+#define DEFAULT_MAX_NO_IMPROVEMENT 10
+
+const char *algorithmName(Algorithm algorithm);
+int parseAlgorithm(const char *name, Algorithm *algorithm);
+const char *initializationName(Initialization init);
+int parseInitialization(const char *name, Initialization *init);
+const char *precisionName(Precision precision);
+int parsePrecision(const char *name, Precision *precision);
+
+// scratch buffers of one kmeans() call, allocated once and reused on every
+// iteration by all the variants
+typedef struct {
+    Arena arena; // holds every buffer, released at once by freeWorkspace
+    int numThreads;
+    Assignments assignments; // maxRows entries, data is NULL if not needed
+    double *prevCentroids; // k rows with the dataframe stride
+    float *centroidsF32; // single precision copy for the float assignment step
+    int16_t *centroidsI16; // quantized copy for the int16 assignment step
+    double *threadSums; // numThreads blocks of sumsBlock doubles
+    int *threadCounts; // numThreads blocks of countsBlock ints
+    size_t sumsBlock;
+    size_t countsBlock;
+
+    // centroid sums kept across iterations, so a sweep only has to add the
+    // points that changed cluster, see applyThreadSums
+    double *runningSums; // k rows with the dataframe stride
+    int *runningCounts;
+    Assignments appliedAssignments; // what the running sums hold, for updateCentroids
+    int sweepsSinceResync; // -1 until the first full sweep
+    int deltaSweep; // the current sweep only adds and removes changed points
+    long long changed; // points that changed cluster in the last sweep
+
+    // assignment kernels, see distance.c
+    ClosestKernel kernel;
+    ClosestKernelF32 kernelF32;
+    ClosestKernelI16 kernelI16;
+    int centroidTile; // centroids per pass over a block, for each kernel
+    int centroidTileF32;
+    int centroidTileI16;
+    size_t scratchBlock;
+    double *threadScratch; // numThreads blocks of scratchBlock doubles
+    float *threadScratchF32;
+    int32_t *threadScratchI16;
+} Workspace;
+
+Workspace *allocWorkspace(Dataframe *df, int k, Isa isa, int withAssignments);
+void freeWorkspace(Workspace *ws);
+
+// the fused assignment step of lloyd, in pieces so several centroid sets can
+// share a sweep over the data
+void prepareAssignment(Dataframe *df, double *centroids, int k, Workspace *ws, Precision precision);
+void assignBlock(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    Workspace *ws,
+    Precision precision,
+    int tid,
+    int begin,
+    int count
+);
+void startSweep(Workspace *ws, int haveAssignments);
+void applyThreadSums(Dataframe *df, double *centroids, int k, Workspace *ws);
+
+double *initCentroids(Dataframe *df, int k, uint64_t seed, Initialization init);
+long long updateCentroids(Dataframe *df, double *centroids, Assignments assignments, int k, Workspace *ws);
+int hasConverged(
+    double *currentCentroids,
+    double *prevCentroids,
+    int k,
+    int numFeatures,
+    int stride,
+    double threshold
+);
+// distances between every pair of centroids and half the distance from each
+// centroid to its nearest neighbour, used by the bounded variants. between
+// is NULL when only the nearest neighbours are needed
+void centroidDistances(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    double *between,
+    double *halfNearest
+);
+double computeInertia(Dataframe *df, double *centroids, int k);
+void centroidDrift(Dataframe *df, double *centroids, double *prevCentroids, int k, double *drift);
+
 void kmeans(
     Dataframe *df, 
     Experiment *exp, 
     int k, 
     int maxIter, 
     int numExp, 
-    int debug
+    int debug,
+    const KmeansConfig *config
 );
 
 #endif
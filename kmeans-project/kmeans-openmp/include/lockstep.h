@@ -0,0 +1,14 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+void kmeansLockstep(
+    Dataframe *df,
+    Experiment *experiments,
+    int numExp,
+    int k,
+    int maxIter,
+    int debug,
+    const KmeansConfig *config
+);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef MINIBATCH_H
+#define MINIBATCH_H
+
+void minibatch(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    int maxIter,
+    Experiment *exp,
+    int debug,
+    Workspace *ws,
+    const KmeansConfig *config
+);
+
+#endif
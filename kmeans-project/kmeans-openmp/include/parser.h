@@ -0,0 +1,28 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+// where the numbers of a delimited text file are
+typedef struct {
+    char delimiter;
+    char comment; // lines starting with it are skipped, 0 if none
+    int skipLines; // lines before the data, e.g. a csv header
+    const char *endOfHeader; // the data starts after the line starting with this, ignoring case, NULL if none
+    const int *columns; // 0 based and increasing, the only fields parsed
+    int numColumns;
+} DelimitedFormat;
+
+// a delimited file: the format of its rows, the names of its columns and
+// the column holding the labels
+typedef struct {
+    DelimitedFormat format;
+    int numFileColumns;
+    const char *const *columnNames; // one per column of the file, NULL if it has no header
+    int labelColumn; // -1 if there is none
+} DelimitedSchema;
+
+int parseDelimitedRow(const char *p, const char *end, const DelimitedFormat *format, double *values);
+int parseDelimitedFile(const char *path, const DelimitedFormat *format, int stride, Arena *arena, double **rows);
+int inferDelimitedSchema(const char *path, DelimitedSchema *schema);
+void freeDelimitedSchema(DelimitedSchema *schema);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef REORDER_H
+#define REORDER_H
+
+// a due sort is skipped while fewer rows than this fraction changed cluster
+// since the last one, the clusters are still almost contiguous
+#define REORDER_MIN_CHANGED 0.01
+
+// private copy of the rows of a dataframe that lloyd keeps sorted by cluster.
+// The dataframe itself is shared by the experiments, so it's never reordered
+typedef struct {
+    // shares the names and the int16 offsets. Until the first sort it also
+    // shares the rows, then its arena holds the sorted copy and rowIds is set
+    Dataframe rows;
+    const Dataframe *source; // the shared dataframe every sort copies from
+    // targets of the next sort, swapped with the ids and assignments after it
+    int *spareIds;
+    void *spareAssignments; // from the arena of the assignments it swaps with
+    int numThreads;
+    size_t countsBlock; // k + 1 counts padded to whole cache lines
+    int *threadCounts; // numThreads blocks of countsBlock counts
+} ClusterOrder;
+
+ClusterOrder *allocClusterOrder(Dataframe *df, int k, Assignments assignments, Arena *assignmentsArena);
+void sortByCluster(ClusterOrder *order, Assignments *assignments, int k);
+void freeClusterOrder(ClusterOrder *order);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+// below this many point-feature-centroid terms per iteration a parallel
+// region costs about as much as the work it splits
+#define SCHEDULE_SMALL_WORK (1 << 20)
+
+const char *scheduleName(Schedule schedule);
+int parseSchedule(const char *name, Schedule *schedule);
+Schedule pickSchedule(Dataframe *df, int numExp, int k, Schedule schedule);
+
+void runExperiments(
+    Dataframe *df,
+    Experiment *experiments,
+    int numExp,
+    int k,
+    int maxIter,
+    int debug,
+    const KmeansConfig *config
+);
+
+#endif
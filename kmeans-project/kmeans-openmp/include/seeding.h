@@ -0,0 +1,8 @@
+#ifndef SEEDING_H
+#define SEEDING_H
+
+void seedRandom(Dataframe *df, double *centroids, int k, uint64_t seed);
+void seedKmeansPlusPlus(Dataframe *df, double *centroids, int k, uint64_t seed);
+void seedKmeansParallel(Dataframe *df, double *centroids, int k, uint64_t seed);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef YINYANG_H
+#define YINYANG_H
+
+void yinyang(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    int maxIter,
+    Experiment *exp,
+    int debug,
+    Workspace *ws
+);
+
+#endif
@@ -0,0 +1,264 @@
+/*
+Binary datasets and out-of-core streaming:
+
+writeBinaryDataset saves a loaded dataframe with the row layout it has in
+memory, and mapBinaryDataset maps such a file read-only instead of loading it,
+so the rows are paged in from the file as the sweeps reach them. A sweep over
+a mapped dataframe goes through the rows in chunks of STREAM_CHUNK_BYTES:
+
+   for each chunk:
+       prefetchRows(next chunk)   <- MADV_WILLNEED, read ahead while assigning
+       assign the chunk
+       releaseRows(chunk)         <- MADV_DONTNEED, drop it from the process
+
+so the resident rows stay a couple of chunks no matter the size of the file.
+The pages dropped are clean, so releasing them is free and the next sweep
+reads them from the page cache if it still holds them, or from the disk.
+Every helper is a no-op on a dataframe that isn't streamed.
+
+Only the rows are streamed. The workspace still holds the cluster of every
+row, 1 to 4 bytes against the 8 * stride bytes of the row, so the process
+stays O(n) but a few times smaller than the file. The bounded variants keep
+one or more doubles of bounds per row, as much as the rows or more, so -o
+only runs lloyd.
+
+The same files cache the parsed text datasets, see loadDataset. A cache is
+stamped with the size and modification time of the text file and with the
+schema it was parsed with, and is only mapped while they still match. A cache
+that isn't streamed keeps its pages like memory does, so repeated runs read
+the rows from the page cache without parsing or copying them.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../include/log.h"
+#include "../include/helper.h"
+#include "../include/distance.h"
+#include "../include/binary.h"
+
+// size and modification time of the source file, 0 if there is none
+static int sourceStamp(const char *source, uint64_t *size, int64_t *mtime) {
+    *size = 0;
+    *mtime = 0;
+    if (source == NULL) {
+        return 1;
+    }
+
+    struct stat info;
+    if (stat(source, &info) != 0) {
+        return 0;
+    }
+    *size = info.st_size;
+    *mtime = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+    return 1;
+}
+
+// the file is written next to path and renamed over it, so a run reading
+// path never sees it half written
+int writeBinaryDataset(const Dataframe *df, const char *path, const char *source, uint64_t schema) {
+    char tmpPath[4096];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%d.tmp", path, (int)getpid());
+
+    FILE *file = fopen(tmpPath, "wb");
+    if (!file) {
+        log_error("Failed to open %s for writing", tmpPath);
+        return 0;
+    }
+
+    size_t namesLength = strlen(df->name) + 1;
+    for (int l = 0; l < df->numFeatures; l++) {
+        namesLength += strlen(df->features[l]) + 1;
+    }
+
+    BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+    header.version = BINARY_VERSION;
+    header.numFeatures = df->numFeatures;
+    header.stride = df->stride;
+    header.dtype = BINARY_DTYPE_FLOAT64;
+    header.numRows = df->maxRows;
+    header.schema = schema;
+    header.maxColumns = df->maxColumns;
+    header.startColumn = df->startColumn;
+    header.endColumn = df->endColumn;
+    header.dataOffset = (sizeof(header) + namesLength + BINARY_ALIGNMENT - 1)
+        / BINARY_ALIGNMENT * BINARY_ALIGNMENT;
+
+    int ok = sourceStamp(source, &header.sourceSize, &header.sourceMtime);
+    ok = ok && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(df->name, strlen(df->name) + 1, 1, file) == 1;
+    for (int l = 0; ok && l < df->numFeatures; l++) {
+        ok = fwrite(df->features[l], strlen(df->features[l]) + 1, 1, file) == 1;
+    }
+    for (size_t i = sizeof(header) + namesLength; ok && i < header.dataOffset; i++) {
+        ok = fputc(0, file) != EOF;
+    }
+    if (ok && df->maxRows > 0) {
+        ok = fwrite(df->data, df->stride * sizeof(double), df->maxRows, file) == (size_t)df->maxRows;
+    }
+
+    if (fclose(file) != 0 || !ok || rename(tmpPath, path) != 0) {
+        log_error("Failed to write %s", path);
+        remove(tmpPath);
+        return 0;
+    }
+
+    log_debug("Wrote %d rows of %s to %s", df->maxRows, df->name, path);
+    return 1;
+}
+
+// the dataframe points into the mapping, freeDataframe unmaps it. With a
+// source, the file is a cache and is only mapped if it was stamped with the
+// source as it is now and with the same schema, a stale cache isn't an error
+int mapBinaryDataset(const char *path, const char *source, uint64_t schema, Dataframe *df) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        log_error("Failed to open %s", path);
+        return 0;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(BinaryHeader)) {
+        log_error("%s is not a binary dataset", path);
+        close(fd);
+        return 0;
+    }
+
+    size_t size = info.st_size;
+    char *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file open
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        log_error("Failed to map %s", path);
+        return 0;
+    }
+
+    BinaryHeader header;
+    memcpy(&header, mapping, sizeof(header));
+    if (source != NULL) {
+        uint64_t sourceSize;
+        int64_t sourceMtime;
+        int current = memcmp(header.magic, BINARY_MAGIC, sizeof(header.magic)) == 0
+            && header.version == BINARY_VERSION
+            && sourceStamp(source, &sourceSize, &sourceMtime)
+            && header.sourceSize == sourceSize
+            && header.sourceMtime == sourceMtime
+            && header.schema == schema;
+        if (!current) {
+            log_debug("%s is out of date with %s", path, source);
+            munmap(mapping, size);
+            return 0;
+        }
+    }
+
+    int valid = memcmp(header.magic, BINARY_MAGIC, sizeof(header.magic)) == 0
+        && header.version == BINARY_VERSION
+        && header.dtype == BINARY_DTYPE_FLOAT64
+        && header.numFeatures > 0
+        && header.startColumn <= header.endColumn
+        && header.endColumn < header.maxColumns
+        && (int)header.stride == rowStride(header.numFeatures)
+        && header.dataOffset % BINARY_ALIGNMENT == 0
+        && header.dataOffset <= size
+        && header.numRows <= (size - header.dataOffset) / (header.stride * sizeof(double));
+    if (!valid) {
+        log_error("%s is not a binary dataset of version %d", path, BINARY_VERSION);
+        munmap(mapping, size);
+        return 0;
+    }
+
+    // the names are NUL terminated strings between the header and the rows
+    const char *names = mapping + sizeof(header);
+    const char *namesEnd = mapping + header.dataOffset;
+    Arena arena = {NULL};
+    char **features = arenaAlloc(&arena, header.numFeatures * sizeof(char *));
+    const char *name = names;
+    for (uint32_t l = 0; l <= header.numFeatures && valid; l++) {
+        const char *end = memchr(names, '\0', namesEnd - names);
+        if (end == NULL) {
+            valid = 0;
+        } else {
+            if (l > 0) {
+                features[l - 1] = (char *)names;
+            }
+            names = end + 1;
+        }
+    }
+    if (!valid) {
+        log_error("%s has truncated feature names", path);
+        releaseArena(&arena);
+        munmap(mapping, size);
+        return 0;
+    }
+
+    memset(df, 0, sizeof(*df));
+    df->name = (char *)name;
+    df->data = (double *)(mapping + header.dataOffset);
+    df->features = features;
+    df->maxRows = header.numRows;
+    df->maxColumns = header.maxColumns;
+    df->numFeatures = header.numFeatures;
+    df->startColumn = header.startColumn;
+    df->endColumn = header.endColumn;
+    df->stride = header.stride;
+    df->mapping = mapping;
+    df->mappedBytes = size;
+    df->arena = arena;
+
+    log_debug("Mapped %d rows of %s from %s", df->maxRows, df->name, path);
+    return 1;
+}
+
+// makes the sweeps over a mapped dataframe go through it chunk by chunk
+void streamDataset(Dataframe *df) {
+    if (df->mapping == NULL) {
+        return;
+    }
+    df->streamed = 1;
+
+    // the sweeps read the rows front to back, so the kernel can read ahead
+    // further and drop pages sooner
+    madvise(df->data, (size_t)df->maxRows * df->stride * sizeof(double), MADV_SEQUENTIAL);
+}
+
+// the whole dataframe when it isn't streamed
+int streamChunkRows(const Dataframe *df) {
+    if (!df->streamed || df->maxRows == 0) {
+        return df->maxRows > 0 ? df->maxRows : 1;
+    }
+    int rows = STREAM_CHUNK_BYTES / (df->stride * sizeof(double));
+    rows = rows / ASSIGN_BLOCK_ROWS * ASSIGN_BLOCK_ROWS;
+    return rows > ASSIGN_BLOCK_ROWS ? rows : ASSIGN_BLOCK_ROWS;
+}
+
+// madvise wants page aligned ranges, the range is widened to whole pages
+static void adviseRows(const Dataframe *df, int begin, int count, int advice) {
+    if (!df->streamed || begin >= df->maxRows || count <= 0) {
+        return;
+    }
+    if (count > df->maxRows - begin) {
+        count = df->maxRows - begin;
+    }
+
+    const size_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)dfRow(df, begin);
+    uintptr_t end = (uintptr_t)dfRow(df, begin + count);
+    start = start / page * page;
+    end = (end + page - 1) / page * page;
+    madvise((void *)start, end - start, advice);
+}
+
+void prefetchRows(const Dataframe *df, int begin, int count) {
+    adviseRows(df, begin, count, MADV_WILLNEED);
+}
+
+void releaseRows(const Dataframe *df, int begin, int count) {
+    adviseRows(df, begin, count, MADV_DONTNEED);
+}
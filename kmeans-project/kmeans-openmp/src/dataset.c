@@ -3,304 +3,287 @@
 #include <math.h>
 #include <time.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "../include/helper.h"
 #include "../include/log.h"
-
-Dataframe loadIris(const char *filename)
+#include "../include/parser.h"
+#include "../include/binary.h"
+
+// parsed datasets are saved here and mapped on the next runs, see loadCached
+#define DATASET_CACHE_DIR "data/cache"
+
+// the built-in datasets, any other delimited or ARFF file is loaded with the
+// schema inferDelimitedSchema finds
+typedef struct {
+    const char *name;
+    const char *path;
+    DelimitedSchema schema;
+} BuiltinDataset;
+
+// Id first, the species label last
+static const int irisColumns[] = {1, 2, 3, 4};
+static const char *const irisNames[] = {
+    "Id", "SepalLengthCm", "SepalWidthCm", "PetalLengthCm", "PetalWidthCm", "Species"
+};
+
+// the ARFF header lines aren't numbers, so they're skipped like the comments
+static const int riceColumns[] = {0, 1, 2, 3, 4, 5};
+static const char *const riceNames[] = {
+    "PerimeterReal", "MajorAxisLengthReal", "MinorAxisLengthReal", "EccentricityReal",
+    "ConvexArea", "ExtentReal", "Class"
+};
+
+static const int htru2Columns[] = {0, 1, 2, 3, 4, 5, 6, 7};
+static const char *const htru2Names[] = {
+    "profileMean", "profileStdev", "profileSkewness", "profileKurtosis",
+    "dmMean", "dmStdev", "dmSkewness", "dmKurtosis", "class"
+};
+
+// nSeq and DI come before the 8 channels, it really has 3 xyz columns
+static const int wesadColumns[] = {2, 3, 4, 5, 6, 7, 8, 9};
+static const char *const wesadNames[] = {
+    "nSeq", "DI", "ECG", "EDA", "EMG", "TEMP", "XYZ", "XYZ", "XYZ", "RESPIRATION"
+};
+
+static const BuiltinDataset builtinDatasets[] = {
+    {"iris", "Iris.csv", {{',', 0, 1, NULL, irisColumns, 4}, 6, irisNames, 5}},
+    {"rice", "data/rice/Rice_Cammeo_Osmancik.arff", {{',', '%', 0, NULL, riceColumns, 6}, 7, riceNames, 6}},
+    {"htru2", "data/htru2/HTRU_2.csv", {{',', 0, 0, NULL, htru2Columns, 8}, 9, htru2Names, 8}},
+    {"wesad", "data/wesad/WESAD/S4/S4_respiban.txt", {{'\t', '#', 0, NULL, wesadColumns, 8}, 10, wesadNames, -1}},
+};
+
+// the dataset name and the names of the selected columns, copied after the
+// array of pointers
+static char **featureNames(const char *name, const DelimitedSchema *schema, Arena *arena, char **datasetName)
 {
-    const int MAX_ROWS = 150;
-    const int MAX_COLUMNS = 6;
-    const int NUM_FEATURES = 4;
-
-    FILE *file = fopen(filename, "r");
-    if (!file)
-    {
-        perror("Error while opening the file");
-        exit(EXIT_FAILURE);
+    const DelimitedFormat *format = &schema->format;
+    char generated[32];
+
+    size_t length = strlen(name) + 1;
+    for (int l = 0; l < format->numColumns; l++) {
+        int column = format->columns[l];
+        length += schema->columnNames != NULL
+            ? strlen(schema->columnNames[column]) + 1
+            : (size_t)snprintf(generated, sizeof(generated), "column%d", column) + 1;
     }
 
-    char header[256]; // ignora head
-    if (fgets(header, sizeof(header), file) == NULL)
-    {
-        perror("Error while reading the header");
-        fclose(file);
+    char **features = arenaAlloc(arena, format->numColumns * sizeof(char *) + length);
+    char *text = (char *)(features + format->numColumns);
+    for (int l = 0; l < format->numColumns; l++) {
+        int column = format->columns[l];
+        if (schema->columnNames != NULL) {
+            strcpy(text, schema->columnNames[column]);
+        } else {
+            snprintf(text, length, "column%d", column);
+        }
+        features[l] = text;
+        text += strlen(text) + 1;
     }
+    strcpy(text, name);
+    *datasetName = text;
+    return features;
+}
 
-    char **features = malloc(NUM_FEATURES * sizeof(char *));
-    double **matrix = malloc(MAX_ROWS * sizeof(double *));
-
-    features[0] = "SepalLengthCm";
-    features[1] = "SepalWidthCm";
-    features[2] = "PetalLengthCm";
-    features[3] = "PetalWidthCm";
-
-    int row = 0;
-    while (row < MAX_ROWS && !feof(file))
-    {
-        int id;
-        double f1, f2, f3, f4;
-        char *label = malloc(50 * sizeof(char)); // preciso alocar memória pro char?
+static Dataframe loadDelimited(const char *name, const char *filename, const DelimitedSchema *schema)
+{
+    const DelimitedFormat *format = &schema->format;
 
-        int result = fscanf(
-            file, "%d,%lf,%lf,%lf,%lf,%49[^\n]\n", &id, &f1, &f2, &f3, &f4, label
-        );
+    int stride = rowStride(format->numColumns);
+    Arena arena = {NULL};
+    double *matrix;
+    int rows = parseDelimitedFile(filename, format, stride, &arena, &matrix);
 
-        matrix[row] = malloc((NUM_FEATURES) * sizeof(double));
+    char *datasetName;
+    char **features = featureNames(name, schema, &arena, &datasetName);
 
-        matrix[row][0] = f1;
-        matrix[row][1] = f2;
-        matrix[row][2] = f3;
-        matrix[row][3] = f4;
-        row++;
-    }
+    log_debug("Loaded %d rows of %d features from %s", rows, format->numColumns, filename);
 
-    log_debug("Loaded %d rows", row);
-
-    fclose(file);
+    // the fields left out, the other storages and the mapping, are zeroed
     Dataframe df = {
-        "iris",
-        matrix,
-        features,
-        MAX_ROWS,
-        MAX_COLUMNS,
-        NUM_FEATURES,
-        1,
-        NUM_FEATURES
+        .name = datasetName,
+        .data = matrix,
+        .features = features,
+        .maxRows = rows,
+        .maxColumns = schema->numFileColumns,
+        .numFeatures = format->numColumns,
+        .startColumn = format->columns[0],
+        .endColumn = format->columns[format->numColumns - 1],
+        .stride = stride,
+        .arena = arena
     };
     return df;
 }
 
-Dataframe loadRice(const char *filename)
+static uint64_t fnv1a(uint64_t hash, const void *bytes, size_t length)
 {
-    const int MAX_ROWS = 3809;
-    const int MAX_COLUMNS = 7;
-    const int NUM_FEATURES = 6;
-    const int ARFF_COMMENTS_TO_IGNORE = 16;
-
-    FILE *file = fopen(filename, "r");
-    if (!file)
-    {
-        perror("Error while opening the file");
-        exit(EXIT_FAILURE);
-    }
-
-    char buffer[256];
-    for(int i = 0; i < ARFF_COMMENTS_TO_IGNORE; i++) {
-        if (fgets(buffer, sizeof(buffer), file) == NULL)
-        {
-            perror("Error while reading the header");
-            fclose(file);
-        }
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ ((const unsigned char *)bytes)[i]) * 1099511628211ULL;
     }
+    return hash;
+}
 
-    double **matrix = malloc(MAX_ROWS * sizeof(double *));
-    char **features = malloc(NUM_FEATURES * sizeof(char *));
-
-    features[0] = "PerimeterReal";
-    features[1] = "MajorAxisLengthReal";
-    features[2] = "MinorAxisLengthReal";
-    features[3] = "EccentricityReal";
-    features[4] = "ConvexArea";
-    features[5] = "ExtentReal";
-
-    int row = 0;
-    while (row < MAX_ROWS && !feof(file))
-    {
-        double f1, f2, f3, f4, f5, f6;
-        char *label = malloc(50 * sizeof(char));
-
-        int result = fscanf(
-            file,
-            "%lf,%lf,%lf,%lf,%lf,%lf,%49[^\n]\n",
-            &f1, &f2, &f3, &f4, &f5, &f6, label
-        );
-
-        matrix[row] = malloc((NUM_FEATURES) * sizeof(double));
+// FNV-1a of what decides the rows a file parses to, so that a cache written
+// with another schema isn't mapped
+static uint64_t schemaFingerprint(const char *filename, const DelimitedFormat *format)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    const char *header = format->endOfHeader != NULL ? format->endOfHeader : "";
+    int fields[] = {format->delimiter, format->comment, format->skipLines, format->numColumns};
+
+    hash = fnv1a(hash, filename, strlen(filename));
+    hash = fnv1a(hash, header, strlen(header));
+    hash = fnv1a(hash, fields, sizeof(fields));
+    return fnv1a(hash, format->columns, format->numColumns * sizeof(int));
+}
 
-        matrix[row][0] = f1;
-        matrix[row][1] = f2;
-        matrix[row][2] = f3;
-        matrix[row][3] = f4;
-        matrix[row][4] = f5;
-        matrix[row][5] = f6;
-        row++;
+// maps the cache of the dataset if it's as recent as the text file and was
+// parsed with the same schema, otherwise parses the text file and writes the
+// cache for the next runs. Failing to write it only costs the next run a parse
+static Dataframe loadCached(
+    const char *name,
+    const char *cacheName,
+    const char *filename,
+    const DelimitedSchema *schema
+) {
+    char cachePath[256];
+    snprintf(cachePath, sizeof(cachePath), "%s/%s.bin", DATASET_CACHE_DIR, cacheName);
+    uint64_t fingerprint = schemaFingerprint(filename, &schema->format);
+
+    Dataframe df;
+    if (access(cachePath, R_OK) == 0 && mapBinaryDataset(cachePath, filename, fingerprint, &df)) {
+        log_debug("Loaded %d rows from the cache %s", df.maxRows, cachePath);
+        return df;
     }
 
-    log_debug("Loaded %d rows", row);
-
-    fclose(file);
-
-    Dataframe df = {
-        "rice",
-        matrix,
-        features,
-        MAX_ROWS,
-        MAX_COLUMNS,
-        NUM_FEATURES,
-        0,
-        NUM_FEATURES
-    };
+    df = loadDelimited(name, filename, schema);
+    mkdir("data", 0755);
+    mkdir(DATASET_CACHE_DIR, 0755);
+    if (writeBinaryDataset(&df, cachePath, filename, fingerprint)) {
+        log_debug("Cached %s in %s", name, cachePath);
+    }
     return df;
 }
 
-Dataframe loadHtru2(const char *filename) {
-    const int MAX_ROWS = 17898;
-    const int MAX_COLUMNS = 9;
-    const int NUM_FEATURES = 8;
-
-    FILE *file = fopen(filename, "r");
-    if (!file)
-    {
-        perror("Error while opening the file");
-        exit(EXIT_FAILURE);
+// a comma separated list of 0 based columns, sorted into *selected
+static int parseColumnList(const char *list, int numFileColumns, int **selected)
+{
+    int *columns = malloc(numFileColumns * sizeof(int));
+    int *keep = calloc(numFileColumns, sizeof(int));
+    const char *p = list;
+
+    while (*p != '\0') {
+        char *after;
+        long column = strtol(p, &after, 10);
+        if (after == p || column < 0 || column >= numFileColumns || (*after != ',' && *after != '\0')) {
+            log_error("Invalid column in %s, the file has columns 0 to %d", list, numFileColumns - 1);
+            free(columns);
+            free(keep);
+            return 0;
+        }
+        keep[column] = 1;
+        p = *after == ',' ? after + 1 : after;
     }
 
-    double **matrix = malloc(MAX_ROWS * sizeof(double *));
-    char **features = malloc(NUM_FEATURES * sizeof(char *));
-
-    features[0] = "profileMean";
-    features[1] = "profileStdev";
-    features[2] = "profileSkewness";
-    features[3] = "profileKurtosis";
-    features[4] = "dmMean";
-    features[5] = "dmStdev";
-    features[6] = "dmSkewness";
-    features[7] = "dmKurtosis";
-
-    int row = 0;
-    while (row < MAX_ROWS && !feof(file))
-    {
-        double f1, f2, f3, f4, f5, f6, f7, f8;
-        char *label = malloc(2 * sizeof(char));
-
-        int result = fscanf(
-            file,
-            "%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%2[^\n]\n",
-            &f1, &f2, &f3, &f4, &f5, &f6, &f7, &f8, label
-        );
-
-        matrix[row] = malloc((NUM_FEATURES) * sizeof(double));
-
-        matrix[row][0] = f1;
-        matrix[row][1] = f2;
-        matrix[row][2] = f3;
-        matrix[row][3] = f4;
-        matrix[row][4] = f5;
-        matrix[row][5] = f6;
-        matrix[row][6] = f7;
-        matrix[row][7] = f8;
-        row++;
+    int count = 0;
+    for (int c = 0; c < numFileColumns; c++) {
+        if (keep[c]) {
+            columns[count++] = c;
+        }
     }
-
-    log_debug("Loaded %d rows", row);
-
-    fclose(file);
-
-    Dataframe df = {
-        "htru2",
-        matrix,
-        features,
-        MAX_ROWS,
-        MAX_COLUMNS,
-        NUM_FEATURES,
-        0,
-        NUM_FEATURES-1
-    };
-    return df;
+    free(keep);
+    *selected = columns;
+    return count;
 }
 
-Dataframe loadWset(const char *filename)
+// the name of a file without its directory and extension
+static void fileDatasetName(const char *path, char *name, size_t size)
 {
-    const int MAX_ROWS = 4558554;
-    const int MAX_COLUMNS = 8;
-    const int NUM_FEATURES = 8;
-
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        perror("Error while opening the file");
-        exit(EXIT_FAILURE);
+    const char *base = strrchr(path, '/');
+    base = base != NULL ? base + 1 : path;
+    snprintf(name, size, "%s", base);
+    char *extension = strrchr(name, '.');
+    if (extension != NULL && extension != name) {
+        *extension = '\0';
     }
+}
 
-    char buffer[512];
+// the cache of a file other than the built-ins is named after its file and a
+// hash of its full path, so it can't collide with theirs or another directory's
+static void fileCacheName(const char *path, const char *name, char *cacheName, size_t size)
+{
+    char *fullPath = realpath(path, NULL);
+    const char *hashed = fullPath != NULL ? fullPath : path;
+    uint64_t hash = fnv1a(14695981039346656037ULL, hashed, strlen(hashed));
+    snprintf(cacheName, size, "%s-%016llx", name, (unsigned long long)hash);
+    free(fullPath);
+}
 
-    while (fgets(buffer, sizeof(buffer), file)) {
-        if (strncmp(buffer, "# EndOfHeader", 13) == 0) {
-            break;
+// datasetName is a built-in dataset or the path of a delimited or ARFF file,
+// columns optionally replaces the columns of its schema
+Dataframe loadDataset(const char *datasetName, const char *columns)
+{
+    DelimitedSchema schema;
+    const char *filename = NULL;
+    char name[128];
+    char cacheName[160];
+    int inferred = 0;
+
+    for (size_t i = 0; i < sizeof(builtinDatasets) / sizeof(builtinDatasets[0]); i++) {
+        if (strcmp(datasetName, builtinDatasets[i].name) == 0) {
+            log_debug("Loading %s dataset...", datasetName);
+            schema = builtinDatasets[i].schema;
+            filename = builtinDatasets[i].path;
+            snprintf(name, sizeof(name), "%s", datasetName);
+            snprintf(cacheName, sizeof(cacheName), "%s", datasetName);
         }
     }
 
-    double **matrix = malloc(MAX_ROWS * sizeof(double *));
-    char **features = malloc(NUM_FEATURES * sizeof(char *));
-
-    features[0] = "ECG";
-    features[1] = "EDA";
-    features[2] = "EMG";
-    features[3] = "TEMP";
-
-    // it really has 3 xyz columns
-    features[4] = "XYZ";
-    features[5] = "XYZ";
-    features[6] = "XYZ";
-
-    features[7] = "RESPIRATION";
-
-    int row = 0;
-    while (row < MAX_ROWS && fgets(buffer, sizeof(buffer), file)) {
-        int nSeq, DI;
-        int ch[8];
-        int count = sscanf(buffer, "%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d",
-            &nSeq, &DI,
-            &ch[0], &ch[1], &ch[2], &ch[3], &ch[4], &ch[5], &ch[6], &ch[7]
+    if (filename == NULL) {
+        if (access(datasetName, R_OK) != 0) {
+            log_error("Unknown dataset: %s\n", datasetName);
+            exit(EXIT_FAILURE);
+        }
+        log_debug("Loading %s with an inferred schema...", datasetName);
+        if (!inferDelimitedSchema(datasetName, &schema)) {
+            log_error("%s has no numeric columns", datasetName);
+            exit(EXIT_FAILURE);
+        }
+        inferred = 1;
+        filename = datasetName;
+        fileDatasetName(datasetName, name, sizeof(name));
+        fileCacheName(datasetName, name, cacheName, sizeof(cacheName));
+        char delimiter[3] = {schema.format.delimiter, '\0', '\0'};
+        if (delimiter[0] == '\t') {
+            strcpy(delimiter, "\\t");
+        }
+        log_debug(
+            "%s: delimiter '%s', %d columns, %d numeric, label column %d",
+            datasetName, delimiter,
+            schema.numFileColumns, schema.format.numColumns, schema.labelColumn
         );
+    }
 
-        if (count != 10) {
-            continue;
+    int *selected = NULL;
+    if (columns != NULL) {
+        int count = parseColumnList(columns, schema.numFileColumns, &selected);
+        if (count == 0) {
+            log_error("No columns selected from %s", datasetName);
+            exit(EXIT_FAILURE);
         }
-
-        matrix[row] = malloc(NUM_FEATURES * sizeof(double));
-        for (int i = 0; i < NUM_FEATURES; i++) {
-            matrix[row][i] = (double)ch[i];
+        if (inferred) {
+            free((void *)schema.format.columns);
         }
-        row++;
+        schema.format.columns = selected;
+        schema.format.numColumns = count;
     }
 
-    fclose(file);
-
-    log_debug("Loaded %d rows from WESAD dataset", row);
-
-    Dataframe df = {
-        "wesad",
-        matrix,
-        features,
-        row,
-        MAX_COLUMNS,
-        NUM_FEATURES,
-        2,
-        NUM_FEATURES
-    };
-    return df;
-}
-
-Dataframe loadDataset(const char *datasetName)
-{
-    if (strcmp(datasetName, "iris") == 0) {
-        log_debug("Loading Iris dataset...");
-
-        return loadIris("Iris.csv");
-    } else if (strcmp(datasetName, "rice") == 0) {
-        log_debug("Loading Rice dataset...");
+    Dataframe df = loadCached(name, cacheName, filename, &schema);
 
-        return loadRice("data/rice/Rice_Cammeo_Osmancik.arff");
-    } else if (strcmp(datasetName, "htru2") == 0) {
-        log_debug("Loading htru2 dataset...");
-
-        return loadHtru2("data/htru2/HTRU_2.csv");
-    } else if (strcmp(datasetName, "wesad") == 0) {
-        log_debug("Loading wesad dataset...");
-
-        return loadWset("data/wesad/WESAD/S4/S4_respiban.txt");
+    if (inferred) {
+        freeDelimitedSchema(&schema);
     } else {
-        log_error("Unknown dataset: %s\n", datasetName);
-        exit(EXIT_FAILURE);
+        free(selected);
     }
+    return df;
 }
@@ -0,0 +1,182 @@
+/*
+Assignment kernels specialized per feature count.
+
+The datasets have 4 to 8 features, too few for the vectorizer to do anything
+useful with the feature loop. Instead, every kernel transposes a block of rows
+into a small feature-major tile and vectorizes across the points of the tile:
+
+   tile[l][i] = rows[i][l]                  <- one pass over the block
+   for each vector of points i:             <- simd lanes
+       for each centroid j:
+           d = sum_l (tile[l][i] - c[j][l])^2   <- unrolled, D is a constant
+           if d < best[i]: best[i] = d, closest[i] = j
+
+The kernels are generated for 2 to 16 features plus a generic one, and the
+right one is picked once per run from the number of features.
+
+With many centroids the centroid table no longer fits in L1 next to the tile,
+and every vector of points would stream it again from L2. The centroid loop is
+tiled instead: a tile of centroids sized from the L1 cache detected at startup
+is compared against every vector of the block, and the running best distance
+and centroid of each point are kept in scratch between tiles.
+
+With many features and many centroids the subtraction in the inner loop is
+what limits the kernel. Above GEMM_MIN_FEATURES and GEMM_MIN_CENTROIDS the
+distances are expanded instead:
+
+   |x - c|^2 = |x|^2 - 2 x.c + |c|^2
+
+|x|^2 is the same for every centroid so the argmin only needs |c|^2 - 2 x.c,
+and the x.c terms of a block are the product of the tile and the centroid
+matrix. The product is computed a panel of two vectors of points at a time,
+small enough to stay in L1 while every centroid streams past it, by a
+microkernel that keeps the partial products of the panel with GEMM_CENTROIDS
+centroids in registers. The expanded form loses some precision to cancellation, so points
+almost equidistant to two centroids can be assigned differently than with the
+direct kernels.
+
+The kernels are written once in distance_kernels.h with intrinsics and
+compiled for SSE2, AVX2 and AVX-512 by distance_sse2.c, distance_avx2.c and
+distance_avx512.c. The instruction set is picked at runtime from what the cpu
+reports, or forced with --isa, so one binary uses the widest vectors of the
+host it runs on.
+
+In int16 precision the kernels read the quantized copy of the data built by
+buildInt16Storage and compare it with centroids quantized the same way, using
+integer madd instructions, so a row takes a quarter of the bytes of a double
+row.
+*/
+
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/log.h"
+#include "../include/helper.h"
+#include "../include/distance.h"
+
+const char *isaName(Isa isa) {
+    switch (isa) {
+        case ISA_SSE2:
+            return "sse2";
+        case ISA_AVX2:
+            return "avx2";
+        case ISA_AVX512:
+            return "avx512";
+        case ISA_AUTO:
+        default:
+            return "auto";
+    }
+}
+
+int parseIsa(const char *name, Isa *isa) {
+    if (strcmp(name, "auto") == 0) {
+        *isa = ISA_AUTO;
+    } else if (strcmp(name, "sse2") == 0) {
+        *isa = ISA_SSE2;
+    } else if (strcmp(name, "avx2") == 0) {
+        *isa = ISA_AVX2;
+    } else if (strcmp(name, "avx512") == 0) {
+        *isa = ISA_AVX512;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// asks cpuid, which also checks that the os saves the wider registers
+int isaSupported(Isa isa) {
+    __builtin_cpu_init();
+    switch (isa) {
+        case ISA_AVX512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+        case ISA_AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case ISA_SSE2:
+        case ISA_AUTO:
+        default:
+            return 1;
+    }
+}
+
+// replaces auto with the widest instruction set of the cpu
+Isa resolveIsa(Isa isa) {
+    if (isa != ISA_AUTO) {
+        return isa;
+    }
+    if (isaSupported(ISA_AVX512)) {
+        return ISA_AVX512;
+    }
+    if (isaSupported(ISA_AVX2)) {
+        return ISA_AVX2;
+    }
+    return ISA_SSE2;
+}
+
+static long l1CacheSize = DEFAULT_L1_CACHE_SIZE;
+
+// sysconf reads the sizes the kernel reports, it returns 0 or -1 where they
+// aren't known
+void detectCacheSizes(void) {
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    long size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    if (size > 0) {
+        l1CacheSize = size;
+    }
+#endif
+    log_debug("L1 data cache: %ld KiB", l1CacheSize / 1024);
+}
+
+// the transposed tile, the best distance and centroid of every row and the
+// centroid norms
+size_t closestScratchSize(int numFeatures, int k) {
+    return (size_t)(numFeatures + 2) * ASSIGN_BLOCK_ROWS + k;
+}
+
+// centroids compared against a block per pass, so that they fit in half of
+// L1 next to the transposed tile and the running minima of the block
+int centroidTileSize(int numFeatures, int stride, size_t elementSize, int k) {
+    long tileBytes = (long)(numFeatures + 2) * ASSIGN_BLOCK_ROWS * elementSize;
+    long budget = l1CacheSize / 2 - tileBytes;
+    long tile = budget / (long)(stride * elementSize) / MIN_CENTROID_TILE * MIN_CENTROID_TILE;
+
+    if (tile < MIN_CENTROID_TILE) {
+        tile = MIN_CENTROID_TILE;
+    }
+    return tile < k ? (int)tile : k;
+}
+
+ClosestKernel selectClosestKernel(int numFeatures, int k, Isa isa) {
+    switch (resolveIsa(isa)) {
+        case ISA_AVX512:
+            return selectClosestKernelAvx512(numFeatures, k);
+        case ISA_AVX2:
+            return selectClosestKernelAvx2(numFeatures, k);
+        case ISA_SSE2:
+        default:
+            return selectClosestKernelSse2(numFeatures, k);
+    }
+}
+
+ClosestKernelF32 selectClosestKernelF32(int numFeatures, int k, Isa isa) {
+    switch (resolveIsa(isa)) {
+        case ISA_AVX512:
+            return selectClosestKernelF32Avx512(numFeatures, k);
+        case ISA_AVX2:
+            return selectClosestKernelF32Avx2(numFeatures, k);
+        case ISA_SSE2:
+        default:
+            return selectClosestKernelF32Sse2(numFeatures, k);
+    }
+}
+
+ClosestKernelI16 selectClosestKernelI16(int numFeatures, Isa isa) {
+    switch (resolveIsa(isa)) {
+        case ISA_AVX512:
+            return selectClosestKernelI16Avx512(numFeatures);
+        case ISA_AVX2:
+            return selectClosestKernelI16Avx2(numFeatures);
+        case ISA_SSE2:
+        default:
+            return selectClosestKernelI16Sse2(numFeatures);
+    }
+}
@@ -0,0 +1,48 @@
+// assignment kernels for AVX2 with FMA, only called when the cpu has both
+
+#pragma GCC target("avx2,fma")
+
+#include <math.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "../include/helper.h"
+#include "../include/distance.h"
+
+#define ISA_NAME(name) name##Avx2
+
+#define VEC_F64 __m256d
+#define LANES_F64 4
+#define MASK_F64 __m256d
+#define LOAD_F64(p) _mm256_loadu_pd(p)
+#define STORE_F64(p, v) _mm256_storeu_pd(p, v)
+#define SET1_F64(x) _mm256_set1_pd(x)
+#define SUB_F64(a, b) _mm256_sub_pd(a, b)
+#define FMA_F64(a, b, c) _mm256_fmadd_pd(a, b, c)
+#define LESS_F64(a, b) _mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define BLEND_F64(m, a, b) _mm256_blendv_pd(a, b, m)
+
+#define VEC_F32 __m256
+#define LANES_F32 8
+#define MASK_F32 __m256
+#define LOAD_F32(p) _mm256_loadu_ps(p)
+#define STORE_F32(p, v) _mm256_storeu_ps(p, v)
+#define SET1_F32(x) _mm256_set1_ps(x)
+#define SUB_F32(a, b) _mm256_sub_ps(a, b)
+#define FMA_F32(a, b, c) _mm256_fmadd_ps(a, b, c)
+#define LESS_F32(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define BLEND_F32(m, a, b) _mm256_blendv_ps(a, b, m)
+
+#define VEC_I32 __m256i
+#define LANES_I32 8
+#define MASK_I32 __m256i
+#define LOAD_I32(p) _mm256_loadu_si256((const __m256i *)(p))
+#define STORE_I32(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define SET1_I32(x) _mm256_set1_epi32(x)
+#define ADD_I32(a, b) _mm256_add_epi32(a, b)
+#define LESS_I32(a, b) _mm256_cmpgt_epi32(b, a)
+#define BLEND_I32(m, a, b) _mm256_blendv_epi8(a, b, m)
+#define SUB_I16(a, b) _mm256_sub_epi16(a, b)
+#define MADD_I16(a, b) _mm256_madd_epi16(a, b)
+
+#include "../include/distance_kernels.h"
@@ -0,0 +1,48 @@
+// assignment kernels for AVX-512F and BW, only called when the cpu supports both
+
+#pragma GCC target("avx512f,avx512bw,avx2,fma")
+
+#include <math.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "../include/helper.h"
+#include "../include/distance.h"
+
+#define ISA_NAME(name) name##Avx512
+
+#define VEC_F64 __m512d
+#define LANES_F64 8
+#define MASK_F64 __mmask8
+#define LOAD_F64(p) _mm512_loadu_pd(p)
+#define STORE_F64(p, v) _mm512_storeu_pd(p, v)
+#define SET1_F64(x) _mm512_set1_pd(x)
+#define SUB_F64(a, b) _mm512_sub_pd(a, b)
+#define FMA_F64(a, b, c) _mm512_fmadd_pd(a, b, c)
+#define LESS_F64(a, b) _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ)
+#define BLEND_F64(m, a, b) _mm512_mask_blend_pd(m, a, b)
+
+#define VEC_F32 __m512
+#define LANES_F32 16
+#define MASK_F32 __mmask16
+#define LOAD_F32(p) _mm512_loadu_ps(p)
+#define STORE_F32(p, v) _mm512_storeu_ps(p, v)
+#define SET1_F32(x) _mm512_set1_ps(x)
+#define SUB_F32(a, b) _mm512_sub_ps(a, b)
+#define FMA_F32(a, b, c) _mm512_fmadd_ps(a, b, c)
+#define LESS_F32(a, b) _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ)
+#define BLEND_F32(m, a, b) _mm512_mask_blend_ps(m, a, b)
+
+#define VEC_I32 __m512i
+#define LANES_I32 16
+#define MASK_I32 __mmask16
+#define LOAD_I32(p) _mm512_loadu_si512(p)
+#define STORE_I32(p, v) _mm512_storeu_si512(p, v)
+#define SET1_I32(x) _mm512_set1_epi32(x)
+#define ADD_I32(a, b) _mm512_add_epi32(a, b)
+#define LESS_I32(a, b) _mm512_cmplt_epi32_mask(a, b)
+#define BLEND_I32(m, a, b) _mm512_mask_blend_epi32(m, a, b)
+#define SUB_I16(a, b) _mm512_sub_epi16(a, b)
+#define MADD_I16(a, b) _mm512_madd_epi16(a, b)
+
+#include "../include/distance_kernels.h"
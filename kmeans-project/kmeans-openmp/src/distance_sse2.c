@@ -0,0 +1,46 @@
+// assignment kernels for SSE2, the x86-64 baseline
+
+#include <math.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "../include/helper.h"
+#include "../include/distance.h"
+
+#define ISA_NAME(name) name##Sse2
+
+#define VEC_F64 __m128d
+#define LANES_F64 2
+#define MASK_F64 __m128d
+#define LOAD_F64(p) _mm_loadu_pd(p)
+#define STORE_F64(p, v) _mm_storeu_pd(p, v)
+#define SET1_F64(x) _mm_set1_pd(x)
+#define SUB_F64(a, b) _mm_sub_pd(a, b)
+#define FMA_F64(a, b, c) _mm_add_pd(_mm_mul_pd(a, b), c)
+#define LESS_F64(a, b) _mm_cmplt_pd(a, b)
+#define BLEND_F64(m, a, b) _mm_or_pd(_mm_and_pd(m, b), _mm_andnot_pd(m, a))
+
+#define VEC_F32 __m128
+#define LANES_F32 4
+#define MASK_F32 __m128
+#define LOAD_F32(p) _mm_loadu_ps(p)
+#define STORE_F32(p, v) _mm_storeu_ps(p, v)
+#define SET1_F32(x) _mm_set1_ps(x)
+#define SUB_F32(a, b) _mm_sub_ps(a, b)
+#define FMA_F32(a, b, c) _mm_add_ps(_mm_mul_ps(a, b), c)
+#define LESS_F32(a, b) _mm_cmplt_ps(a, b)
+#define BLEND_F32(m, a, b) _mm_or_ps(_mm_and_ps(m, b), _mm_andnot_ps(m, a))
+
+#define VEC_I32 __m128i
+#define LANES_I32 4
+#define MASK_I32 __m128i
+#define LOAD_I32(p) _mm_loadu_si128((const __m128i *)(p))
+#define STORE_I32(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define SET1_I32(x) _mm_set1_epi32(x)
+#define ADD_I32(a, b) _mm_add_epi32(a, b)
+#define LESS_I32(a, b) _mm_cmplt_epi32(a, b)
+#define BLEND_I32(m, a, b) _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a))
+#define SUB_I16(a, b) _mm_sub_epi16(a, b)
+#define MADD_I16(a, b) _mm_madd_epi16(a, b)
+
+#include "../include/distance_kernels.h"
@@ -0,0 +1,160 @@
+/*
+Elkan's accelerated K-Means (Elkan, 2003):
+
+For every data point x assigned to centroid a(x) the algorithm keeps
+   - an upper bound u(x) >= d(x, c_a(x))
+   - k lower bounds l(x, j) <= d(x, c_j)
+
+and, on every iteration, the distances between centroids d(c_i, c_j) and
+s(c) = 1/2 min_{j != c} d(c, c_j).
+
+By the triangle inequality a point can't change cluster when u(x) <= s(a(x)),
+and the distance to c_j only has to be computed when u(x) > l(x, j) and
+u(x) > 1/2 d(c_a(x), c_j). After the update step the bounds are moved by how
+far each centroid drifted, so the assignments are the same as Lloyd's.
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+#include <string.h>
+
+#include "../include/log.h"
+#include "../include/helper.h"
+#include "../include/experiments.h"
+#include "../include/distance.h"
+#include "../include/kmeans.h"
+#include "../include/elkan.h"
+
+void elkan(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    int maxIter,
+    Experiment *exp,
+    int debug,
+    Workspace *ws
+) {
+    int n = df->maxRows;
+
+    Assignments assignments = ws->assignments;
+    double *upper = arenaAlloc(&ws->arena, n * sizeof(double));
+    double *lower = arenaAlloc(&ws->arena, (size_t)n * k * sizeof(double));
+    double *between = arenaAlloc(&ws->arena, k * k * sizeof(double));
+    double *halfNearest = arenaAlloc(&ws->arena, k * sizeof(double));
+    double *drift = arenaAlloc(&ws->arena, k * sizeof(double));
+    double *prevCentroids = ws->prevCentroids;
+
+    long long distances = 0;
+
+    // the first pass computes every distance, which makes all the bounds tight
+    log_debug("Initializing Elkan bounds...");
+    #pragma omp parallel for schedule(static) reduction(+:distances)
+    for (int i = 0; i < n; i++) {
+        const double *row = dfRow(df, i);
+        double *l = lower + (size_t)i * k;
+        double minDistance = INFINITY;
+        int closestCentroid = 0;
+
+        for (int j = 0; j < k; j++) {
+            l[j] = euclideanDistance(row, centroids + j * df->stride, df->numFeatures);
+            if (l[j] < minDistance) {
+                minDistance = l[j];
+                closestCentroid = j;
+            }
+        }
+
+        setAssignment(assignments, i, closestCentroid);
+        upper[i] = minDistance;
+        distances += k;
+    }
+
+    int iteration = 0;
+
+    while (maxIter > 0)
+    {
+        if (iteration > 0) {
+            log_debug("Updating assignments with Elkan bounds...");
+            centroidDistances(df, centroids, k, between, halfNearest);
+
+            // most points are pruned, so the work per row is uneven
+            #pragma omp parallel for schedule(dynamic, 1024) reduction(+:distances)
+            for (int i = 0; i < n; i++) {
+                int a = getAssignment(assignments, i);
+                double u = upper[i];
+
+                if (u <= halfNearest[a]) {
+                    continue;
+                }
+
+                const double *row = dfRow(df, i);
+                double *l = lower + (size_t)i * k;
+                int tight = 0;
+
+                for (int j = 0; j < k; j++) {
+                    if (j == a || u <= l[j] || u <= 0.5 * between[a * k + j]) {
+                        continue;
+                    }
+
+                    // tighten the upper bound once before testing any other centroid
+                    if (!tight) {
+                        u = euclideanDistance(row, centroids + a * df->stride, df->numFeatures);
+                        l[a] = u;
+                        tight = 1;
+                        distances++;
+
+                        if (u <= l[j] || u <= 0.5 * between[a * k + j]) {
+                            continue;
+                        }
+                    }
+
+                    double distance = euclideanDistance(
+                        row, centroids + j * df->stride, df->numFeatures
+                    );
+                    l[j] = distance;
+                    distances++;
+
+                    if (distance < u) {
+                        a = j;
+                        u = distance;
+                    }
+                }
+
+                setAssignment(assignments, i, a);
+                upper[i] = u;
+            }
+        }
+
+        if(debug) {
+            saveIterationData(centroids, assignments, df, k, iteration, exp->number);
+        }
+
+        memcpy(prevCentroids, centroids, (size_t)k * df->stride * sizeof(double));
+        exp->changedPoints += updateCentroids(df, centroids, assignments, k, ws);
+
+        if (hasConverged(
+            centroids, prevCentroids, k, df->numFeatures, df->stride, CONVERGENCE_THRESHOLD
+        )) {
+            log_debug("Convergence achieved after %d iterations.", iteration + 1);
+            break;
+        }
+
+        // loosen the bounds by how far each centroid moved
+        centroidDrift(df, centroids, prevCentroids, k, drift);
+
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++) {
+            double *l = lower + (size_t)i * k;
+            upper[i] += drift[getAssignment(assignments, i)];
+            for (int j = 0; j < k; j++) {
+                l[j] = fmax(l[j] - drift[j], 0.0);
+            }
+        }
+
+        log_debug("Max iterations left: %d", --maxIter);
+        iteration++;
+    }
+
+    exp->convergenceIteration = iteration;
+    exp->distanceCount += distances;
+}
@@ -5,10 +5,13 @@
 #include <string.h>
 #include "../include/helper.h"
 #include "../include/log.h"
+#include "../include/distance.h"
+#include "../include/kmeans.h"
+#include "../include/schedule.h"
 
 void saveIterationData(
-    double **centroids,
-    int *assignments,
+    double *centroids,
+    Assignments assignments,
     Dataframe *df,
     int k,
     int iteration,
@@ -51,20 +54,32 @@ void saveIterationData(
 
     fprintf(file, "point_id,dataset,%s,cluster\n", features);
 
-    for (int i = 0; i < df->maxRows; i++) {
-        fprintf(file, "%d", i);
+    // reordered rows are written back in file order
+    int *rowOf = NULL;
+    if (df->rowIds != NULL) {
+        rowOf = malloc(df->maxRows * sizeof(int));
+        for (int i = 0; i < df->maxRows; i++) {
+            rowOf[df->rowIds[i]] = i;
+        }
+    }
+
+    for (int id = 0; id < df->maxRows; id++) {
+        int i = rowOf != NULL ? rowOf[id] : id;
+        const double *row = dfRow(df, i);
+        fprintf(file, "%d", id);
         fprintf(file, ",%s", df->name);
         for (int j = 0; j < df->numFeatures; j++) {
-            fprintf(file, ",%f", df->data[i][j]);
+            fprintf(file, ",%f", row[j]);
         }
-        fprintf(file, ",%d\n", assignments[i]);
+        fprintf(file, ",%d\n", getAssignment(assignments, i));
     }
+    free(rowOf);
 
     for (int i = 0; i < k; i++) {
         fprintf(file, "c%d", i);
         fprintf(file, ",%s", df->name);
         for (int j = 0; j < df->numFeatures; j++) {
-            fprintf(file, ",%f", centroids[i][j]);
+            fprintf(file, ",%f", centroids[i * df->stride + j]);
         }
         fprintf(file, ",%d\n", i);
     }
@@ -76,11 +91,19 @@ void saveIterationData(
 
 void saveExperiment(Experiment *experiments, int numberExperiments, char *dataframe) {
     char filename[100];
-    sprintf(
-        filename,
-        "experiments/%s_experiment_result.csv",
-        dataframe
-    );
+    Algorithm algorithm = numberExperiments > 0 ? experiments[0].algorithm : ALGORITHM_LLOYD;
+
+    // lloyd keeps the original file name so older results stay comparable
+    if (algorithm == ALGORITHM_LLOYD) {
+        sprintf(filename, "experiments/%s_experiment_result.csv", dataframe);
+    } else {
+        sprintf(
+            filename,
+            "experiments/%s_%s_experiment_result.csv",
+            dataframe,
+            algorithmName(algorithm)
+        );
+    }
 
     FILE *file = fopen(filename, "w");
     if (!file) {
@@ -88,15 +111,23 @@ void saveExperiment(Experiment *experiments, int numberExperiments, char *datafr
         return;
     }
 
-    fprintf(file, "iteration,dataset,time,converged_at\n");
+    fprintf(file, "iteration,dataset,time,converged_at,algorithm,init,precision,isa,schedule,distances,changed,inertia\n");
     for(int i = 0; i < numberExperiments; i++) {
         fprintf(
             file,
-            "%d,%s,%f,%d\n",
+            "%d,%s,%f,%d,%s,%s,%s,%s,%s,%lld,%lld,%f\n",
             i,
             dataframe,
             experiments[i].executionTime,
-            experiments[i].convergenceIteration
+            experiments[i].convergenceIteration,
+            algorithmName(experiments[i].algorithm),
+            initializationName(experiments[i].init),
+            precisionName(experiments[i].precision),
+            isaName(experiments[i].isa),
+            scheduleName(experiments[i].schedule),
+            experiments[i].distanceCount,
+            experiments[i].changedPoints,
+            experiments[i].inertia
         );
     }
     fclose(file);
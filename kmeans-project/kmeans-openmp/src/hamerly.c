@@ -0,0 +1,161 @@
+/*
+Hamerly's accelerated K-Means (Hamerly, 2010):
+
+A lighter version of Elkan's algorithm that keeps only two bounds per point:
+   - an upper bound u(x) >= d(x, c_a(x))
+   - one lower bound l(x) <= d(x, c_j) for every j != a(x)
+
+A point can't change cluster when u(x) <= max(s(a(x)), l(x)), where s(c) is
+half the distance from c to its nearest centroid. Otherwise the upper bound is
+tightened and, if that's not enough, every distance of the point is computed.
+After the update step u(x) grows by the drift of its own centroid and l(x)
+shrinks by the largest drift of the others. It uses 2n extra doubles instead
+of Elkan's n * k, which is what matters for large n and few features.
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+#include <string.h>
+
+#include "../include/log.h"
+#include "../include/helper.h"
+#include "../include/experiments.h"
+#include "../include/distance.h"
+#include "../include/kmeans.h"
+#include "../include/hamerly.h"
+
+// computes every distance of a row, returns the closest centroid and the
+// distances to the closest and the second closest ones
+static int closestTwo(
+    Dataframe *df,
+    const double *row,
+    double *centroids,
+    int k,
+    double *closest,
+    double *secondClosest
+) {
+    double first = INFINITY;
+    double second = INFINITY;
+    int closestCentroid = 0;
+
+    for (int j = 0; j < k; j++) {
+        double distance = euclideanDistance(row, centroids + j * df->stride, df->numFeatures);
+        if (distance < first) {
+            second = first;
+            first = distance;
+            closestCentroid = j;
+        } else if (distance < second) {
+            second = distance;
+        }
+    }
+
+    *closest = first;
+    *secondClosest = second;
+    return closestCentroid;
+}
+
+void hamerly(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    int maxIter,
+    Experiment *exp,
+    int debug,
+    Workspace *ws
+) {
+    int n = df->maxRows;
+
+    Assignments assignments = ws->assignments;
+    double *upper = arenaAlloc(&ws->arena, n * sizeof(double));
+    double *lower = arenaAlloc(&ws->arena, n * sizeof(double));
+    double *halfNearest = arenaAlloc(&ws->arena, k * sizeof(double));
+    double *drift = arenaAlloc(&ws->arena, k * sizeof(double));
+    double *prevCentroids = ws->prevCentroids;
+
+    long long distances = 0;
+
+    log_debug("Initializing Hamerly bounds...");
+    #pragma omp parallel for schedule(static) reduction(+:distances)
+    for (int i = 0; i < n; i++) {
+        int closest = closestTwo(df, dfRow(df, i), centroids, k, &upper[i], &lower[i]);
+        setAssignment(assignments, i, closest);
+        distances += k;
+    }
+
+    int iteration = 0;
+
+    while (maxIter > 0)
+    {
+        if (iteration > 0) {
+            log_debug("Updating assignments with Hamerly bounds...");
+            centroidDistances(df, centroids, k, NULL, halfNearest);
+
+            #pragma omp parallel for schedule(dynamic, 1024) reduction(+:distances)
+            for (int i = 0; i < n; i++) {
+                int a = getAssignment(assignments, i);
+                double bound = fmax(halfNearest[a], lower[i]);
+
+                if (upper[i] <= bound) {
+                    continue;
+                }
+
+                const double *row = dfRow(df, i);
+                upper[i] = euclideanDistance(row, centroids + a * df->stride, df->numFeatures);
+                distances++;
+
+                if (upper[i] <= bound) {
+                    continue;
+                }
+
+                int closest = closestTwo(df, row, centroids, k, &upper[i], &lower[i]);
+                setAssignment(assignments, i, closest);
+                distances += k;
+            }
+        }
+
+        if(debug) {
+            saveIterationData(centroids, assignments, df, k, iteration, exp->number);
+        }
+
+        memcpy(prevCentroids, centroids, (size_t)k * df->stride * sizeof(double));
+        exp->changedPoints += updateCentroids(df, centroids, assignments, k, ws);
+
+        if (hasConverged(
+            centroids, prevCentroids, k, df->numFeatures, df->stride, CONVERGENCE_THRESHOLD
+        )) {
+            log_debug("Convergence achieved after %d iterations.", iteration + 1);
+            break;
+        }
+
+        centroidDrift(df, centroids, prevCentroids, k, drift);
+
+        // the lower bound of a point covers every centroid but its own, so it
+        // shrinks by the largest drift, or the second largest if that one is its own
+        int largest = 0;
+        for (int j = 1; j < k; j++) {
+            if (drift[j] > drift[largest]) {
+                largest = j;
+            }
+        }
+        double secondLargest = 0.0;
+        for (int j = 0; j < k; j++) {
+            if (j != largest && drift[j] > secondLargest) {
+                secondLargest = drift[j];
+            }
+        }
+
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++) {
+            int a = getAssignment(assignments, i);
+            upper[i] += drift[a];
+            lower[i] -= a == largest ? secondLargest : drift[largest];
+        }
+
+        log_debug("Max iterations left: %d", --maxIter);
+        iteration++;
+    }
+
+    exp->convergenceIteration = iteration;
+    exp->distanceCount += distances;
+}
@@ -1,4 +1,259 @@
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
+#include "../include/log.h"
+#include "../include/helper.h"
 
+/*
+Arenas:
+
+The dataframe, the kd-tree and the workspace of every experiment allocate
+all their buffers from an arena, which maps memory in blocks of at least
+ARENA_BLOCK_SIZE and hands it out by bumping an offset. Nothing allocated
+from an arena is freed on its own, releaseArena unmaps every block at once
+when its owner is freed:
+
+   block -> [header | buffer | buffer | ... | free]
+     |
+   block -> [header | large buffer]
+
+A buffer too large for the free space of the first block gets a block of
+its own, linked after the first one, so the small buffers keep filling the
+first block. Mapped blocks come zeroed from the kernel.
+
+With huge pages on, blocks are sized and aligned to HUGE_PAGE_SIZE and
+advised with MADV_HUGEPAGE, so the rows and the bounds of the large datasets
+are covered by a few TLB entries.
+*/
+
+// the block header takes a whole cache line, so the buffers stay aligned
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size;
+    size_t used;
+};
+
+static int hugePages = 0;
+
+void setHugePages(int enabled) {
+    hugePages = enabled;
+}
+
+static ArenaBlock *mapArenaBlock(size_t size) {
+    size_t alignment = hugePages ? HUGE_PAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+    size = (size + alignment - 1) / alignment * alignment;
+
+    // huge pages need 2 MB aligned blocks, the extra mapped around the
+    // aligned block is unmapped again
+    size_t mapped = hugePages ? size + HUGE_PAGE_SIZE : size;
+    char *memory = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return NULL;
+    }
+
+    char *start = memory;
+    if (hugePages) {
+        start = (char *)(((uintptr_t)memory + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+        if (start > memory) {
+            munmap(memory, start - memory);
+        }
+        if (memory + mapped > start + size) {
+            munmap(start + size, memory + mapped - (start + size));
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(start, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    ArenaBlock *block = (ArenaBlock *)start;
+    block->next = NULL;
+    block->size = size;
+    block->used = DATA_ALIGNMENT;
+    return block;
+}
+
+// zeroed and aligned to a cache line, exits if the memory ran out. Not thread
+// safe, every arena is filled by one thread
+void *arenaAlloc(Arena *arena, size_t size) {
+    size = (size + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+    if (size == 0) {
+        size = DATA_ALIGNMENT;
+    }
+
+    ArenaBlock *block = arena->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        size_t blockSize = DATA_ALIGNMENT + size;
+        ArenaBlock *fresh = mapArenaBlock(blockSize > ARENA_BLOCK_SIZE ? blockSize : ARENA_BLOCK_SIZE);
+        if (fresh == NULL) {
+            log_error("Failed to map an arena block for %zu bytes", size);
+            exit(EXIT_FAILURE);
+        }
+
+        if (block != NULL && fresh->size - DATA_ALIGNMENT - size < block->size - block->used) {
+            // the first block has more room left for the small buffers
+            fresh->next = block->next;
+            block->next = fresh;
+        } else {
+            fresh->next = block;
+            arena->blocks = fresh;
+        }
+        block = fresh;
+    }
+
+    void *buffer = (char *)block + block->used;
+    block->used += size;
+    return buffer;
+}
+
+void releaseArena(Arena *arena) {
+    ArenaBlock *block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        munmap(block, block->size);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
+
+int rowStride(int numFeatures) {
+    // pad short rows to a power of two so a row never straddles a cache line,
+    // wider rows are padded to a whole number of cache lines
+    const int lineDoubles = DATA_ALIGNMENT / sizeof(double);
+
+    if (numFeatures > lineDoubles) {
+        return (numFeatures + lineDoubles - 1) / lineDoubles * lineDoubles;
+    }
+
+    int stride = 1;
+    while (stride < numFeatures) {
+        stride *= 2;
+    }
+    return stride;
+}
+
+static void *allocAligned(size_t size) {
+    // aligned_alloc wants the size to be a multiple of the alignment
+    size = (size + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+    if (size == 0) {
+        size = DATA_ALIGNMENT;
+    }
+
+    void *buffer = aligned_alloc(DATA_ALIGNMENT, size);
+    if (buffer != NULL) {
+        memset(buffer, 0, size);
+    }
+    return buffer;
+}
+
+double *allocMatrix(int rows, int stride) {
+    return allocAligned((size_t)rows * stride * sizeof(double));
+}
+
+// every entry starts as -1 (all bits set), so every row counts as changed on
+// the first sweep
+Assignments allocAssignments(Arena *arena, int rows, int k) {
+    Assignments assignments;
+    assignments.width = k < UINT8_MAX ? 1 : k < UINT16_MAX ? 2 : 4;
+    assignments.data = arenaAlloc(arena, (size_t)rows * assignments.width);
+    memset(assignments.data, 0xff, (size_t)rows * assignments.width);
+    return assignments;
+}
+
+void buildFloatStorage(Dataframe *df) {
+    if (df->dataF32 != NULL) {
+        return;
+    }
+
+    df->dataF32 = arenaAlloc(&df->arena, (size_t)df->maxRows * df->stride * sizeof(float));
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < df->maxRows; i++) {
+        const double *row = dfRow(df, i);
+        float *rowF32 = dfRowF32(df, i);
+        for (int j = 0; j < df->numFeatures; j++) {
+            rowF32[j] = (float)row[j];
+        }
+    }
+}
+
+// the int16 distances are accumulated in int32, so every column is shifted
+// to start at 0 and, if its range is too wide for the sum of numFeatures
+// squared differences to fit, all the columns are shifted right by the same
+// number of bits, which keeps the distances proportional. Returns 0 if the
+// data has non integer values
+int buildInt16Storage(Dataframe *df) {
+    if (df->dataI16 != NULL) {
+        return 1;
+    }
+
+    double *minimum = malloc(df->numFeatures * sizeof(double));
+    double *maximum = malloc(df->numFeatures * sizeof(double));
+    int integral = 1;
+
+    for (int j = 0; j < df->numFeatures; j++) {
+        minimum[j] = INFINITY;
+        maximum[j] = -INFINITY;
+    }
+
+    for (int i = 0; i < df->maxRows && integral; i++) {
+        const double *row = dfRow(df, i);
+        for (int j = 0; j < df->numFeatures; j++) {
+            if (row[j] != floor(row[j])) {
+                integral = 0;
+                break;
+            }
+            minimum[j] = fmin(minimum[j], row[j]);
+            maximum[j] = fmax(maximum[j], row[j]);
+        }
+    }
+
+    if (!integral) {
+        free(minimum);
+        free(maximum);
+        return 0;
+    }
+
+    double limit = fmin(INT16_MAX, floor(sqrt((double)INT32_MAX / df->numFeatures)));
+    int shift = 0;
+    for (int j = 0; j < df->numFeatures; j++) {
+        while (ldexp(maximum[j] - minimum[j], -shift) > limit) {
+            shift++;
+        }
+    }
+
+    df->strideI16 = (df->numFeatures + 1) / 2 * 2;
+    df->shiftI16 = shift;
+    df->offsetsI16 = minimum;
+    df->dataI16 = arenaAlloc(&df->arena, (size_t)df->maxRows * df->strideI16 * sizeof(int16_t));
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < df->maxRows; i++) {
+        const double *row = dfRow(df, i);
+        int16_t *rowI16 = dfRowI16(df, i);
+        for (int j = 0; j < df->numFeatures; j++) {
+            rowI16[j] = (int16_t)((long)(row[j] - minimum[j]) >> shift);
+        }
+    }
+
+    free(maximum);
+    return 1;
+}
+
+// the rows, their copies and the names go with the arena
+void freeDataframe(Dataframe *df) {
+    if (df->mapping != NULL) {
+        munmap(df->mapping, df->mappedBytes);
+        df->mapping = NULL;
+    }
+    releaseArena(&df->arena);
+    free(df->offsetsI16);
+    df->data = NULL;
+    df->dataF32 = NULL;
+    df->dataI16 = NULL;
+    df->offsetsI16 = NULL;
+    df->features = NULL;
+}
@@ -0,0 +1,524 @@
+/*
+Filtering k-means over a kd-tree (Kanungo et al., 2002):
+
+The tree splits the rows at the median of the widest dimension of their
+bounding box until a cell holds at most KDTREE_LEAF_SIZE points, and every
+node caches the bounding box and the sum of its points. Each iteration pushes
+the candidate centroids down the tree:
+
+   filter(node, candidates):
+       z* = candidate closest to the middle of the cell
+       drop every candidate z that is farther than z* from the whole cell,
+       i.e. from the corner of the cell furthest in the direction z - z*
+       if only z* is left: add the cached sum and count of the cell to z*
+       else if leaf: assign each point to its closest remaining candidate
+       else: filter(left, remaining), filter(right, remaining)
+
+With few features most cells far from the cluster borders end up with a single
+candidate, so their points are never touched. The assignments are the same as
+Lloyd's. The tree is built once per dataset with tasks, before the experiments
+that share it, and every iteration filters a frontier of subtrees in parallel.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../include/log.h"
+#include "../include/helper.h"
+#include "../include/experiments.h"
+#include "../include/distance.h"
+#include "../include/kmeans.h"
+#include "../include/kdtree.h"
+
+static double coordinate(Dataframe *df, KdTree *tree, int i, int dim) {
+    return tree->points[(size_t)i * df->stride + dim];
+}
+
+// swaps two rows of the tree along with their indices
+static void swapRows(Dataframe *df, KdTree *tree, int a, int b) {
+    double *rowA = tree->points + (size_t)a * df->stride;
+    double *rowB = tree->points + (size_t)b * df->stride;
+    for (int l = 0; l < df->numFeatures; l++) {
+        double value = rowA[l];
+        rowA[l] = rowB[l];
+        rowB[l] = value;
+    }
+
+    int index = tree->perm[a];
+    tree->perm[a] = tree->perm[b];
+    tree->perm[b] = index;
+}
+
+// reorders the rows [begin, end) so row nth holds the nth smallest value of
+// dim, smaller ones before it and larger ones after it
+static void selectNth(Dataframe *df, KdTree *tree, int begin, int end, int nth, int dim) {
+    int lo = begin;
+    int hi = end - 1;
+
+    while (lo < hi) {
+        double pivot = coordinate(df, tree, lo + (hi - lo) / 2, dim);
+        int i = lo;
+        int j = hi;
+        while (i <= j) {
+            while (coordinate(df, tree, i, dim) < pivot) {
+                i++;
+            }
+            while (coordinate(df, tree, j, dim) > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                swapRows(df, tree, i, j);
+                i++;
+                j--;
+            }
+        }
+        if (nth <= j) {
+            hi = j;
+        } else if (nth >= i) {
+            lo = i;
+        } else {
+            return;
+        }
+    }
+}
+
+static int newNode(KdTree *tree) {
+    int node;
+    #pragma omp atomic capture
+    node = tree->numNodes++;
+    return node;
+}
+
+// tight bounding box and sum of the rows [begin, end) of a leaf
+static void summarizeLeaf(Dataframe *df, KdTree *tree, int node) {
+    const int d = df->numFeatures;
+    double *lo = tree->lo + (size_t)node * df->stride;
+    double *hi = tree->hi + (size_t)node * df->stride;
+    double *sum = tree->sum + (size_t)node * df->stride;
+    int begin = tree->begin[node];
+
+    memcpy(lo, tree->points + (size_t)begin * df->stride, d * sizeof(double));
+    memcpy(hi, lo, d * sizeof(double));
+    memset(sum, 0, d * sizeof(double));
+    for (int i = begin; i < tree->end[node]; i++) {
+        const double *row = tree->points + (size_t)i * df->stride;
+        for (int l = 0; l < d; l++) {
+            lo[l] = row[l] < lo[l] ? row[l] : lo[l];
+            hi[l] = row[l] > hi[l] ? row[l] : hi[l];
+            sum[l] += row[l];
+        }
+    }
+}
+
+// a parent covers the boxes and sums of its children
+static void mergeChildren(Dataframe *df, KdTree *tree, int node) {
+    const int d = df->numFeatures;
+    double *lo = tree->lo + (size_t)node * df->stride;
+    double *hi = tree->hi + (size_t)node * df->stride;
+    double *sum = tree->sum + (size_t)node * df->stride;
+    const double *leftLo = tree->lo + (size_t)tree->left[node] * df->stride;
+    const double *leftHi = tree->hi + (size_t)tree->left[node] * df->stride;
+    const double *leftSum = tree->sum + (size_t)tree->left[node] * df->stride;
+    const double *rightLo = tree->lo + (size_t)tree->right[node] * df->stride;
+    const double *rightHi = tree->hi + (size_t)tree->right[node] * df->stride;
+    const double *rightSum = tree->sum + (size_t)tree->right[node] * df->stride;
+
+    for (int l = 0; l < d; l++) {
+        lo[l] = leftLo[l] < rightLo[l] ? leftLo[l] : rightLo[l];
+        hi[l] = leftHi[l] > rightHi[l] ? leftHi[l] : rightHi[l];
+        sum[l] = leftSum[l] + rightSum[l];
+    }
+}
+
+// on entry lo and hi of the node hold its cell, the region cut out by the
+// splits above it, which picks the split. On return they hold the tight box of
+// its points, computed bottom up so every row is read once outside selectNth
+static void buildNode(Dataframe *df, KdTree *tree, int node, int begin, int end, int depth) {
+    const int d = df->numFeatures;
+    double *lo = tree->lo + (size_t)node * df->stride;
+    double *hi = tree->hi + (size_t)node * df->stride;
+
+    tree->begin[node] = begin;
+    tree->end[node] = end;
+    tree->left[node] = -1;
+    tree->right[node] = -1;
+
+    // median splits halve the rows, so this is reached even if they are all equal
+    if (end - begin <= KDTREE_LEAF_SIZE) {
+        #pragma omp critical(kdtreeDepth)
+        if (depth > tree->depth) {
+            tree->depth = depth;
+        }
+        summarizeLeaf(df, tree, node);
+        return;
+    }
+
+    int split = 0;
+    for (int l = 1; l < d; l++) {
+        if (hi[l] - lo[l] > hi[split] - lo[split]) {
+            split = l;
+        }
+    }
+
+    int mid = begin + (end - begin) / 2;
+    selectNth(df, tree, begin, end, mid, split);
+    double median = coordinate(df, tree, mid, split);
+
+    int left = newNode(tree);
+    int right = newNode(tree);
+    tree->left[node] = left;
+    tree->right[node] = right;
+
+    double *leftHi = tree->hi + (size_t)left * df->stride;
+    double *rightLo = tree->lo + (size_t)right * df->stride;
+    memcpy(tree->lo + (size_t)left * df->stride, lo, d * sizeof(double));
+    memcpy(leftHi, hi, d * sizeof(double));
+    memcpy(rightLo, lo, d * sizeof(double));
+    memcpy(tree->hi + (size_t)right * df->stride, hi, d * sizeof(double));
+    leftHi[split] = median;
+    rightLo[split] = median;
+
+    #pragma omp task if(end - begin > KDTREE_TASK_ROWS)
+    buildNode(df, tree, left, begin, mid, depth + 1);
+    #pragma omp task if(end - begin > KDTREE_TASK_ROWS)
+    buildNode(df, tree, right, mid, end, depth + 1);
+    #pragma omp taskwait
+
+    mergeChildren(df, tree, node);
+}
+
+KdTree *buildKdTree(Dataframe *df) {
+    log_debug("Building kd-tree...");
+    KdTree *tree = malloc(sizeof(KdTree));
+
+    // median splits leave more than half a leaf in every leaf, so there are
+    // at most 2n / KDTREE_LEAF_SIZE + 1 leaves and twice as many nodes
+    tree->capacity = 4 * (df->maxRows / KDTREE_LEAF_SIZE + 1);
+    tree->numNodes = 1;
+    tree->depth = 0;
+    tree->arena = (Arena){NULL};
+    Arena *arena = &tree->arena;
+    size_t rowBytes = (size_t)df->stride * sizeof(double);
+    tree->perm = arenaAlloc(arena, df->maxRows * sizeof(int));
+    tree->points = arenaAlloc(arena, df->maxRows * rowBytes);
+    tree->begin = arenaAlloc(arena, tree->capacity * sizeof(int));
+    tree->end = arenaAlloc(arena, tree->capacity * sizeof(int));
+    tree->left = arenaAlloc(arena, tree->capacity * sizeof(int));
+    tree->right = arenaAlloc(arena, tree->capacity * sizeof(int));
+    tree->lo = arenaAlloc(arena, tree->capacity * rowBytes);
+    tree->hi = arenaAlloc(arena, tree->capacity * rowBytes);
+    tree->sum = arenaAlloc(arena, tree->capacity * rowBytes);
+
+    // the rows are copied and moved around with their indices, so every node
+    // owns a contiguous range of them
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < df->maxRows; i++) {
+        tree->perm[i] = i;
+        memcpy(tree->points + (size_t)i * df->stride, dfRow(df, i), df->stride * sizeof(double));
+    }
+
+    // the cell of the root is the box of the whole dataset
+    tree->begin[0] = 0;
+    tree->end[0] = df->maxRows;
+    summarizeLeaf(df, tree, 0);
+
+    #pragma omp parallel
+    #pragma omp single
+    buildNode(df, tree, 0, 0, df->maxRows, 0);
+
+    log_debug("Kd-tree built with %d nodes and depth %d", tree->numNodes, tree->depth);
+    return tree;
+}
+
+void freeKdTree(KdTree *tree) {
+    releaseArena(&tree->arena);
+    free(tree);
+}
+
+// is z farther than zStar from every point of the box? Only the corner of
+// the box furthest in the direction z - zStar has to be checked
+static int isFarther(
+    const double *z,
+    const double *zStar,
+    const double *lo,
+    const double *hi,
+    int numFeatures
+) {
+    double zDistance = 0.0;
+    double zStarDistance = 0.0;
+    for (int l = 0; l < numFeatures; l++) {
+        double corner = z[l] > zStar[l] ? hi[l] : lo[l];
+        double dz = z[l] - corner;
+        double dzStar = zStar[l] - corner;
+        zDistance += dz * dz;
+        zStarDistance += dzStar * dzStar;
+    }
+    // strict, so a tie keeps both and the points pick the first like Lloyd
+    return zDistance > zStarDistance;
+}
+
+typedef struct {
+    Dataframe *df;
+    KdTree *tree;
+    const double *centroids;
+    int k;
+    double *sums; // of the thread
+    int *counts;
+    Assignments owners; // cluster of every tree row, in tree order
+    Assignments assignments; // written only if kept
+    ClosestKernel kernel;
+    int centroidTile;
+    double *scratch; // of the thread
+    double *remainingCentroids; // k rows of the thread
+    double *middle; // one row of the thread
+    long long distances;
+    long long changed; // tree rows whose owner changed
+} Filter;
+
+// candidates holds numCandidates centroid indices in increasing order, the
+// lists of the children are written right after it
+static void filterNode(Filter *filter, int node, int *candidates, int numCandidates) {
+    Dataframe *df = filter->df;
+    KdTree *tree = filter->tree;
+    const int d = df->numFeatures;
+    const double *lo = tree->lo + (size_t)node * df->stride;
+    const double *hi = tree->hi + (size_t)node * df->stride;
+
+    int *remaining = candidates + filter->k;
+    int numRemaining = 0;
+
+    if (numCandidates > 1) {
+        double *mid = filter->middle;
+        for (int l = 0; l < d; l++) {
+            mid[l] = (lo[l] + hi[l]) / 2;
+        }
+
+        int zStar = candidates[0];
+        double best = INFINITY;
+        for (int c = 0; c < numCandidates; c++) {
+            double distance = squaredEuclideanDistance(
+                mid, filter->centroids + candidates[c] * df->stride, d
+            );
+            if (distance < best) {
+                best = distance;
+                zStar = candidates[c];
+            }
+        }
+        filter->distances += numCandidates;
+
+        const double *zStarCentroid = filter->centroids + zStar * df->stride;
+        for (int c = 0; c < numCandidates; c++) {
+            int z = candidates[c];
+            if (z == zStar || !isFarther(filter->centroids + z * df->stride, zStarCentroid, lo, hi, d)) {
+                remaining[numRemaining++] = z;
+            }
+        }
+        filter->distances += 2 * (numCandidates - 1);
+    } else {
+        remaining[numRemaining++] = candidates[0];
+    }
+
+    int begin = tree->begin[node];
+    int end = tree->end[node];
+
+    if (numRemaining == 1) {
+        int owner = remaining[0];
+        const double *sum = tree->sum + (size_t)node * df->stride;
+        double *ownerSums = filter->sums + owner * df->stride;
+        for (int l = 0; l < d; l++) {
+            ownerSums[l] += sum[l];
+        }
+        filter->counts[owner] += end - begin;
+
+        // a byte or two per point, read in order, the points themselves
+        // are still never touched
+        for (int i = begin; i < end; i++) {
+            if (getAssignment(filter->owners, i) != owner) {
+                setAssignment(filter->owners, i, owner);
+                filter->changed++;
+            }
+        }
+        if (filter->assignments.data != NULL) {
+            for (int i = begin; i < end; i++) {
+                setAssignment(filter->assignments, tree->perm[i], owner);
+            }
+        }
+        return;
+    }
+
+    if (tree->left[node] < 0) {
+        // the assignment kernels only see the centroids left in the cell
+        for (int c = 0; c < numRemaining; c++) {
+            memcpy(
+                filter->remainingCentroids + c * df->stride,
+                filter->centroids + remaining[c] * df->stride,
+                d * sizeof(double)
+            );
+        }
+
+        int closest[ASSIGN_BLOCK_ROWS];
+        for (int block = begin; block < end; block += ASSIGN_BLOCK_ROWS) {
+            int count = end - block < ASSIGN_BLOCK_ROWS ? end - block : ASSIGN_BLOCK_ROWS;
+            const double *rows = tree->points + (size_t)block * df->stride;
+            filter->kernel(
+                rows, df->stride, count, d,
+                filter->remainingCentroids, numRemaining, filter->centroidTile,
+                filter->scratch, closest
+            );
+
+            for (int b = 0; b < count; b++) {
+                int cluster = remaining[closest[b]];
+                const double *row = rows + (size_t)b * df->stride;
+                double *clusterSums = filter->sums + cluster * df->stride;
+                for (int l = 0; l < d; l++) {
+                    clusterSums[l] += row[l];
+                }
+                filter->counts[cluster]++;
+
+                if (getAssignment(filter->owners, block + b) != cluster) {
+                    setAssignment(filter->owners, block + b, cluster);
+                    filter->changed++;
+                }
+                if (filter->assignments.data != NULL) {
+                    setAssignment(filter->assignments, tree->perm[block + b], cluster);
+                }
+            }
+        }
+        filter->distances += (long long)(end - begin) * numRemaining;
+        return;
+    }
+
+    filterNode(filter, tree->left[node], remaining, numRemaining);
+    filterNode(filter, tree->right[node], remaining, numRemaining);
+}
+
+// subtrees filtered in parallel, enough of them to balance the threads
+static int *treeFrontier(KdTree *tree, int *size) {
+    int target = 8 * omp_get_max_threads();
+    int *frontier = malloc(tree->numNodes * sizeof(int));
+    int count = 1;
+    frontier[0] = 0;
+
+    int expanded = 1;
+    while (count < target && expanded) {
+        expanded = 0;
+        int next = 0;
+        int *children = malloc(2 * count * sizeof(int));
+        for (int i = 0; i < count; i++) {
+            int node = frontier[i];
+            if (tree->left[node] >= 0) {
+                children[next++] = tree->left[node];
+                children[next++] = tree->right[node];
+                expanded = 1;
+            } else {
+                children[next++] = node;
+            }
+        }
+        memcpy(frontier, children, next * sizeof(int));
+        free(children);
+        count = next;
+    }
+
+    *size = count;
+    return frontier;
+}
+
+void kdtreeFiltering(
+    Dataframe *df,
+    KdTree *tree,
+    double *centroids,
+    int k,
+    int maxIter,
+    Experiment *exp,
+    int debug,
+    Workspace *ws
+) {
+    int frontierSize;
+    int *frontier = treeFrontier(tree, &frontierSize);
+
+    // candidate lists for every level below a frontier node, per thread
+    size_t listsPerThread = (size_t)(tree->depth + 2) * k;
+    int *threadCandidates = malloc(ws->numThreads * listsPerThread * sizeof(int));
+    // k rows for the centroids left in a cell and one for its middle
+    double *threadCentroids = allocMatrix(ws->numThreads * (k + 1), df->stride);
+
+    // the cells are assigned without visiting their points, so the per point
+    // assignments are only filled in to save the iterations in debug mode.
+    // The owners in tree order are kept to count the points that changed
+    Assignments owners = allocAssignments(&ws->arena, df->maxRows, k);
+    Assignments assignments = ws->assignments;
+    if (!debug) {
+        assignments.data = NULL;
+    }
+
+    int iteration = 0;
+
+    while (maxIter > 0)
+    {
+        log_debug("Filtering %d subtrees...", frontierSize);
+        startSweep(ws, 0);
+        long long distances = 0;
+        long long changed = 0;
+
+        #pragma omp parallel reduction(+:distances, changed)
+        {
+            int tid = omp_get_thread_num();
+            int *candidates = threadCandidates + tid * listsPerThread;
+            Filter filter = {
+                df,
+                tree,
+                centroids,
+                k,
+                ws->threadSums + tid * ws->sumsBlock,
+                ws->threadCounts + tid * ws->countsBlock,
+                owners,
+                assignments,
+                ws->kernel,
+                ws->centroidTile,
+                ws->threadScratch + tid * ws->scratchBlock,
+                threadCentroids + (size_t)tid * (k + 1) * df->stride,
+                threadCentroids + ((size_t)tid * (k + 1) + k) * df->stride,
+                0,
+                0
+            };
+
+            // the subtrees are very uneven once whole cells get assigned
+            #pragma omp for schedule(dynamic, 1)
+            for (int f = 0; f < frontierSize; f++) {
+                for (int j = 0; j < k; j++) {
+                    candidates[j] = j;
+                }
+                filterNode(&filter, frontier[f], candidates, k);
+            }
+
+            distances += filter.distances;
+            changed += filter.changed;
+        }
+        exp->distanceCount += distances;
+        exp->changedPoints += changed;
+
+        if(debug) {
+            saveIterationData(centroids, assignments, df, k, iteration, exp->number);
+        }
+
+        memcpy(ws->prevCentroids, centroids, (size_t)k * df->stride * sizeof(double));
+        applyThreadSums(df, centroids, k, ws);
+
+        if (hasConverged(
+            centroids, ws->prevCentroids, k, df->numFeatures, df->stride, CONVERGENCE_THRESHOLD
+        )) {
+            log_debug("Convergence achieved after %d iterations.", iteration + 1);
+            break;
+        }
+
+        log_debug("Max iterations left: %d", --maxIter);
+        iteration++;
+    }
+
+    exp->convergenceIteration = iteration;
+
+    free(threadCandidates);
+    free(threadCentroids);
+    free(frontier);
+}
@@ -2,7 +2,8 @@
 Algorithm K-Means Clustering:
 
 1. Initialize centroids
-   - Randomly select k data points from the dataset as initial centroids.
+   - Select k data points from the dataset as initial centroids, uniformly or
+     with kmeans++ / kmeans|| (see seeding.c).
 
 2. Repeat until convergence:
    a. Assignment step:
@@ -23,7 +24,6 @@ End Algorithm
 */
 
 #include <stdlib.h>
-#include <time.h>
 #include <math.h>
 #include <omp.h>
 #include <string.h>
@@ -31,22 +31,33 @@ End Algorithm
 #include "../include/log.h"
 #include "../include/helper.h"
 #include "../include/experiments.h"
-
-double **initCentroids(Dataframe *df, int k, int expNumber) {
-    // Initialize centroids by randomly selecting k data points from the dataset
-    srand(time(NULL) + expNumber);
-
-    log_debug("Initializing centroids randomly...");
-    double **centroids = malloc(k * sizeof(double *));
-
-    for (int i = 0; i < k; i++)
-    {
-        int random_index = rand() % df->maxRows;
-        centroids[i] = malloc(df->numFeatures * sizeof(double));
-        for (int j = 0; j < df->numFeatures; j++)
-        {
-            centroids[i][j] = df->data[random_index][j];
-        }
+#include "../include/distance.h"
+#include "../include/kmeans.h"
+#include "../include/elkan.h"
+#include "../include/hamerly.h"
+#include "../include/yinyang.h"
+#include "../include/minibatch.h"
+#include "../include/kdtree.h"
+#include "../include/reorder.h"
+#include "../include/binary.h"
+#include "../include/seeding.h"
+
+double *initCentroids(Dataframe *df, int k, uint64_t seed, Initialization init) {
+    log_debug("Initializing centroids with %s...", initializationName(init));
+    // centroids share the row layout of the dataframe
+    double *centroids = allocMatrix(k, df->stride);
+
+    switch (init) {
+        case INIT_KMEANS_PLUS_PLUS:
+            seedKmeansPlusPlus(df, centroids, k, seed);
+            break;
+        case INIT_KMEANS_PARALLEL:
+            seedKmeansParallel(df, centroids, k, seed);
+            break;
+        case INIT_RANDOM:
+        default:
+            seedRandom(df, centroids, k, seed);
+            break;
     }
 
     log_debug("Centroids initialized!");
@@ -54,130 +65,355 @@ double **initCentroids(Dataframe *df, int k, int expNumber) {
     return centroids;
 }
 
-int *initAssignments(Dataframe *df, double **centroids, int k) {
-    // assign each data point to the nearest centroid
-    log_debug("Initializing assignments...");
-    int *assignments = malloc(df->maxRows * sizeof(int));
+Workspace *allocWorkspace(Dataframe *df, int k, Isa isa, int withAssignments) {
+    Workspace *ws = malloc(sizeof(Workspace));
+    const size_t lineDoubles = DATA_ALIGNMENT / sizeof(double);
+    const size_t lineInts = DATA_ALIGNMENT / sizeof(int);
+
+    // each thread gets its own blocks, padded to whole cache lines so two
+    // threads never write to the same line
+    ws->numThreads = omp_get_max_threads();
+    ws->sumsBlock = ((size_t)k * df->stride + lineDoubles - 1) / lineDoubles * lineDoubles;
+    ws->countsBlock = ((size_t)k + lineInts - 1) / lineInts * lineInts;
+
+    Arena *arena = &ws->arena;
+    ws->arena = (Arena){NULL};
+    ws->assignments = (Assignments){0, NULL};
+    if (withAssignments) {
+        ws->assignments = allocAssignments(arena, df->maxRows, k);
+    }
+    ws->prevCentroids = arenaAlloc(arena, (size_t)k * df->stride * sizeof(double));
+    ws->centroidsF32 = arenaAlloc(arena, (size_t)k * df->stride * sizeof(float));
+    ws->centroidsI16 = arenaAlloc(arena, (size_t)k * df->strideI16 * sizeof(int16_t));
+    ws->threadSums = arenaAlloc(arena, ws->numThreads * ws->sumsBlock * sizeof(double));
+    ws->threadCounts = arenaAlloc(arena, ws->numThreads * ws->countsBlock * sizeof(int));
+
+    ws->runningSums = arenaAlloc(arena, (size_t)k * df->stride * sizeof(double));
+    ws->runningCounts = arenaAlloc(arena, k * sizeof(int));
+    ws->appliedAssignments = (Assignments){0, NULL}; // only the bounded variants need it
+    ws->sweepsSinceResync = -1;
+    ws->deltaSweep = 0;
+    ws->changed = 0;
+
+    // the assignment kernel is picked once for the whole run
+    ws->kernel = selectClosestKernel(df->numFeatures, k, isa);
+    ws->kernelF32 = selectClosestKernelF32(df->numFeatures, k, isa);
+    ws->kernelI16 = selectClosestKernelI16(df->numFeatures, isa);
+    ws->centroidTile = centroidTileSize(df->numFeatures, df->stride, sizeof(double), k);
+    ws->centroidTileF32 = centroidTileSize(df->numFeatures, df->stride, sizeof(float), k);
+    // the int16 copy only exists in int16 precision
+    ws->centroidTileI16 = k;
+    if (df->dataI16 != NULL) {
+        ws->centroidTileI16 = centroidTileSize(df->numFeatures, df->strideI16, sizeof(int16_t), k);
+    }
+    ws->scratchBlock = (closestScratchSize(df->numFeatures, k) + lineDoubles - 1) / lineDoubles * lineDoubles;
+    ws->threadScratch = arenaAlloc(arena, ws->numThreads * ws->scratchBlock * sizeof(double));
+    ws->threadScratchF32 = arenaAlloc(arena, ws->numThreads * ws->scratchBlock * sizeof(float));
+    ws->threadScratchI16 = arenaAlloc(arena, ws->numThreads * ws->scratchBlock * sizeof(int32_t));
 
-    // k has fixed size, features too, the distance calculation is uniform
-    // since there's no imbalance we're using static
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < df->maxRows; i++)
-    {
-        double minDistance = INFINITY;
-        int closestCentroid = -1;
+    return ws;
+}
 
-        // TODO: check how performance behaves without simd
-        // k is small, not sure if it's worth it to paralell
-        for (int j = 0; j < k; j++)
-        {
-            double sum = 0.0f;
-            #pragma omp simd reduction(+:sum)
-            for (int l = 0; l < df->numFeatures; l++)
-            {
-                double diff = df->data[i][l] - centroids[j][l];
-                sum += diff * diff;
-            }
+// every buffer of the workspace, and those the variants took from its
+// arena, goes in one release
+void freeWorkspace(Workspace *ws) {
+    releaseArena(&ws->arena);
+    free(ws);
+}
 
-            double distance = sqrt(sum);
+static void clearThreadSums(Workspace *ws) {
+    memset(ws->threadSums, 0, ws->numThreads * ws->sumsBlock * sizeof(double));
+    memset(ws->threadCounts, 0, ws->numThreads * ws->countsBlock * sizeof(int));
+}
 
-            if (distance < minDistance)
-            {
-                minDistance = distance;
-                closestCentroid = j;
+// starts a sweep that accumulates into the per thread sums. Once the running
+// sums exist only the points that changed cluster are added to their new
+// centroid and removed from the old one, but every DELTA_RESYNC_INTERVAL
+// sweeps the sums are rebuilt from every point so the rounding errors of the
+// deltas can't pile up
+void startSweep(Workspace *ws, int haveAssignments) {
+    ws->deltaSweep = haveAssignments
+        && ws->sweepsSinceResync >= 0
+        && ws->sweepsSinceResync < DELTA_RESYNC_INTERVAL;
+    ws->sweepsSinceResync = ws->deltaSweep ? ws->sweepsSinceResync + 1 : 0;
+    ws->changed = 0;
+    clearThreadSums(ws);
+}
+
+// joins the per thread sums into the running sums and moves every non empty
+// centroid to its mean. The thread sums are either deltas or, after a full
+// sweep, the complete sums
+void applyThreadSums(Dataframe *df, double *centroids, int k, Workspace *ws) {
+    double *sums = ws->threadSums;
+    int *counts = ws->threadCounts;
+
+    for (int t = 1; t < ws->numThreads; t++) {
+        const double *threadSums = ws->threadSums + t * ws->sumsBlock;
+        const int *threadCounts = ws->threadCounts + t * ws->countsBlock;
+        for (int i = 0; i < k; i++) {
+            counts[i] += threadCounts[i];
+            for (int j = 0; j < df->numFeatures; j++) {
+                sums[i * df->stride + j] += threadSums[i * df->stride + j];
             }
         }
+    }
 
-        assignments[i] = closestCentroid;
+    if (ws->deltaSweep) {
+        for (int i = 0; i < k; i++) {
+            ws->runningCounts[i] += counts[i];
+            for (int j = 0; j < df->numFeatures; j++) {
+                ws->runningSums[i * df->stride + j] += sums[i * df->stride + j];
+            }
+        }
+    } else {
+        memcpy(ws->runningCounts, counts, k * sizeof(int));
+        memcpy(ws->runningSums, sums, (size_t)k * df->stride * sizeof(double));
     }
 
-    return assignments;
+    for (int i = 0; i < k; i++) {
+        if (ws->runningCounts[i] > 0) {
+            for (int j = 0; j < df->numFeatures; j++) {
+                centroids[i * df->stride + j] =
+                    ws->runningSums[i * df->stride + j] / ws->runningCounts[i];
+            }
+        }
+    }
 }
 
-// TODO: avoid reallocating the memory
-void updateCentroids(Dataframe *df, double **centroids, int *assignments, int k) {
-    log_debug("Updating centroids...");
+// converts the centroids to the precision of the assignment kernels and
+// starts the sweep, once per sweep before the blocks are assigned.
+//
+// In float precision the rows and the centroids are read as floats, which
+// halves the memory traffic and doubles the simd width of the distances,
+// while the sums are still accumulated in double.
+//
+// In int16 precision the rows are read from the quantized copy and compared
+// with centroids quantized the same way. A quantized value q stands for
+// offset + scale * q + (scale - 1) / 2, the middle of the integers it
+// covers, and the sums add that value back in double.
+void prepareAssignment(Dataframe *df, double *centroids, int k, Workspace *ws, Precision precision) {
+    // without the previous assignments there's nothing to diff against
+    startSweep(ws, ws->assignments.data != NULL);
+
+    if (precision == PRECISION_FLOAT) {
+        for (int j = 0; j < k; j++) {
+            for (int l = 0; l < df->numFeatures; l++) {
+                ws->centroidsF32[j * df->stride + l] = (float)centroids[j * df->stride + l];
+            }
+        }
+    } else if (precision == PRECISION_INT16) {
+        const double scale = ldexp(1.0, df->shiftI16);
+        for (int j = 0; j < k; j++) {
+            for (int l = 0; l < df->numFeatures; l++) {
+                double q = round((centroids[j * df->stride + l] - df->offsetsI16[l] - (scale - 1) / 2) / scale);
+                ws->centroidsI16[j * df->strideI16 + l] = (int16_t)fmin(fmax(q, 0), INT16_MAX);
+            }
+        }
+    }
+}
 
-    // allocate the newCentroids
-    double **newCentroids = malloc(k * sizeof(double *));
-    int *counts = calloc(k, sizeof(int));
-    for (int i = 0; i < k; i++) {
-        newCentroids[i] = calloc(df->numFeatures, sizeof(double));
+// assigns the count rows starting at begin to their nearest centroid and adds
+// them to the sums of thread tid while they're still in cache, or in a delta
+// sweep only the rows that changed cluster
+void assignBlock(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    Workspace *ws,
+    Precision precision,
+    int tid,
+    int begin,
+    int count
+) {
+    double *sums = ws->threadSums + tid * ws->sumsBlock;
+    int *counts = ws->threadCounts + tid * ws->countsBlock;
+    int closest[ASSIGN_BLOCK_ROWS];
+
+    // only used in int16 precision
+    const double scale = ldexp(1.0, df->shiftI16);
+    const double *offsets = df->offsetsI16;
+
+    if (precision == PRECISION_INT16) {
+        ws->kernelI16(
+            dfRowI16(df, begin), df->strideI16, count, df->numFeatures,
+            ws->centroidsI16, k, ws->centroidTileI16,
+            ws->threadScratchI16 + tid * ws->scratchBlock, closest
+        );
+    } else if (precision == PRECISION_FLOAT) {
+        ws->kernelF32(
+            dfRowF32(df, begin), df->stride, count, df->numFeatures,
+            ws->centroidsF32, k, ws->centroidTileF32,
+            ws->threadScratchF32 + tid * ws->scratchBlock, closest
+        );
+    } else {
+        ws->kernel(
+            dfRow(df, begin), df->stride, count, df->numFeatures,
+            centroids, k, ws->centroidTile,
+            ws->threadScratch + tid * ws->scratchBlock, closest
+        );
     }
 
-    // each thread will work with a different memory to work with
-    // this section allocates them
-    int num_threads = omp_get_max_threads();
-    double ***thread_sums = malloc(num_threads * sizeof(double **));
-    int **thread_counts = malloc(num_threads * sizeof(int *));
-
-    for (int t = 0; t < num_threads; t++) {
-        thread_counts[t] = calloc(k, sizeof(int));
-        thread_sums[t] = malloc(k * sizeof(double *));
-        for (int i = 0; i < k; i++) {
-            thread_sums[t][i] = calloc(df->numFeatures, sizeof(double));
+    int changed = 0;
+    for (int b = 0; b < count; b++) {
+        int cluster = closest[b];
+        int previous = -1;
+        if (ws->assignments.data != NULL) {
+            previous = getAssignment(ws->assignments, begin + b);
+            setAssignment(ws->assignments, begin + b, cluster);
         }
-    }
 
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < df->maxRows; i++) {
-        int tid = omp_get_thread_num();
-        int cluster = assignments[i];
-        thread_counts[tid][cluster]++;
+        // a full sweep adds every row to its cluster, a delta sweep only
+        // the changed ones, which it also removes from their old cluster
+        int passes = 1;
+        if (previous != cluster) {
+            changed++;
+            passes = ws->deltaSweep ? 2 : 1;
+        } else if (ws->deltaSweep) {
+            continue;
+        }
 
-        for (int j = 0; j < df->numFeatures; j++) {
-            thread_sums[tid][cluster][j] += df->data[i][j];
+        for (int pass = 0; pass < passes; pass++) {
+            int target = pass == 0 ? cluster : previous;
+            double sign = pass == 0 ? 1.0 : -1.0;
+            double *clusterSums = sums + target * df->stride;
+            counts[target] += (int)sign;
+
+            if (precision == PRECISION_INT16) {
+                const int16_t *row = dfRowI16(df, begin + b);
+                for (int l = 0; l < df->numFeatures; l++) {
+                    clusterSums[l] += sign * (offsets[l] + (scale - 1) / 2 + scale * row[l]);
+                }
+            } else if (precision == PRECISION_FLOAT) {
+                const float *row = dfRowF32(df, begin + b);
+                for (int l = 0; l < df->numFeatures; l++) {
+                    clusterSums[l] += sign * (double)row[l];
+                }
+            } else {
+                const double *row = dfRow(df, begin + b);
+                for (int l = 0; l < df->numFeatures; l++) {
+                    clusterSums[l] += sign * row[l];
+                }
+            }
         }
     }
 
-    // join the parallelized thread work
-    for (int t = 0; t < num_threads; t++) {
-        for (int i = 0; i < k; i++) {
-            counts[i] += thread_counts[t][i];
-            for (int j = 0; j < df->numFeatures; j++) {
-                newCentroids[i][j] += thread_sums[t][i][j];
+    if (ws->assignments.data != NULL) {
+        #pragma omp atomic
+        ws->changed += changed;
+    }
+}
+
+// one sweep over the data: assigns every point to the nearest centroid and
+// adds it to the running sums of that centroid, so updating the centroids
+// afterwards doesn't need a second pass. The rows are processed in blocks
+// small enough to still be in cache when they're added to the sums. A mapped
+// dataframe is streamed in chunks, see binary.c, otherwise it's a single one.
+static void assignAndAccumulate(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    Workspace *ws,
+    Precision precision
+) {
+    log_debug("Assigning points and accumulating sums in %s precision...", precisionName(precision));
+    prepareAssignment(df, centroids, k, ws, precision);
+
+    const int chunkRows = streamChunkRows(df);
+
+    for (int chunk = 0; chunk < df->maxRows; chunk += chunkRows) {
+        int chunkEnd = df->maxRows - chunk < chunkRows ? df->maxRows : chunk + chunkRows;
+        int numBlocks = (chunkEnd - chunk + ASSIGN_BLOCK_ROWS - 1) / ASSIGN_BLOCK_ROWS;
+        prefetchRows(df, chunkEnd, chunkRows);
+
+        // k has fixed size, features too, the distance calculation is uniform
+        // since there's no imbalance we're using static
+        #pragma omp parallel
+        {
+            int tid = omp_get_thread_num();
+
+            #pragma omp for schedule(static)
+            for (int block = 0; block < numBlocks; block++)
+            {
+                int begin = chunk + block * ASSIGN_BLOCK_ROWS;
+                int count = chunkEnd - begin < ASSIGN_BLOCK_ROWS
+                    ? chunkEnd - begin
+                    : ASSIGN_BLOCK_ROWS;
+                assignBlock(df, centroids, k, ws, precision, tid, begin, count);
             }
         }
+
+        releaseRows(df, chunk, chunkEnd - chunk);
     }
+}
 
-    for (int i = 0; i < k; i++) {
-        if (counts[i] > 0) {
+// recomputes the centroids from the assignments of the bounded variants.
+// Their assignments are diffed against the ones the running sums hold, so
+// most sweeps only read the rows of the points that changed cluster. Returns
+// how many did
+long long updateCentroids(Dataframe *df, double *centroids, Assignments assignments, int k, Workspace *ws) {
+    log_debug("Updating centroids...");
+
+    if (ws->appliedAssignments.data == NULL) {
+        ws->appliedAssignments = allocAssignments(&ws->arena, df->maxRows, k);
+    }
+    startSweep(ws, 1);
+
+    long long changed = 0;
+    Assignments applied = ws->appliedAssignments;
+    int delta = ws->deltaSweep;
+
+    // each thread will work with a different memory to work with
+    #pragma omp parallel reduction(+:changed)
+    {
+        int tid = omp_get_thread_num();
+        double *sums = ws->threadSums + tid * ws->sumsBlock;
+        int *counts = ws->threadCounts + tid * ws->countsBlock;
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < df->maxRows; i++) {
+            int cluster = getAssignment(assignments, i);
+            int previous = getAssignment(applied, i);
+            if (cluster == previous && delta) {
+                continue;
+            }
+
+            const double *row = dfRow(df, i);
+            counts[cluster]++;
             for (int j = 0; j < df->numFeatures; j++) {
-                centroids[i][j] = newCentroids[i][j] / counts[i];
+                sums[cluster * df->stride + j] += row[j];
             }
-        }
-    }
 
-    for (int t = 0; t < num_threads; t++) {
-        for (int i = 0; i < k; i++) {
-            free(thread_sums[t][i]);
+            if (cluster != previous) {
+                changed++;
+                setAssignment(applied, i, cluster);
+                if (delta) {
+                    counts[previous]--;
+                    for (int j = 0; j < df->numFeatures; j++) {
+                        sums[previous * df->stride + j] -= row[j];
+                    }
+                }
+            }
         }
-        free(thread_sums[t]);
-        free(thread_counts[t]);
     }
-    free(thread_sums);
-    free(thread_counts);
 
-    for (int i = 0; i < k; i++) {
-        free(newCentroids[i]);
-    }
-    free(newCentroids);
-    free(counts);
+    ws->changed = changed;
+    applyThreadSums(df, centroids, k, ws);
 
-    log_debug("Centroids updated!");
+    log_debug("Centroids updated, %lld points changed cluster", changed);
+    return changed;
 }
 
-
 int hasConverged(
-    double **currentCentroids,
-    double **prevCentroids,
+    double *currentCentroids,
+    double *prevCentroids,
     int k,
     int numFeatures,
+    int stride,
     double threshold
 ) {
     for (int i = 0; i < k; i++) {
         for (int j = 0; j < numFeatures; j++) {
-            if (fabs(currentCentroids[i][j] - prevCentroids[i][j]) > threshold) {
+            if (fabs(currentCentroids[i * stride + j] - prevCentroids[i * stride + j]) > threshold) {
                 return 0;
             }
         }
@@ -185,44 +421,126 @@ int hasConverged(
     return 1;
 }
 
-void kmeans(Dataframe *df, Experiment *exp, int k, int maxIter, int expNumber, int debug) {
-    const double CONVERGENCE_THRESHOLD = 1e-6;
+void centroidDistances(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    double *between,
+    double *halfNearest
+) {
+    for (int i = 0; i < k; i++) {
+        halfNearest[i] = INFINITY;
+        if (between != NULL) {
+            between[i * k + i] = 0.0;
+        }
+    }
 
-    double start, end;
-    double wall_time_used;
+    for (int i = 0; i < k; i++) {
+        for (int j = i + 1; j < k; j++) {
+            double distance = euclideanDistance(
+                centroids + i * df->stride, centroids + j * df->stride, df->numFeatures
+            );
+            if (between != NULL) {
+                between[i * k + j] = distance;
+                between[j * k + i] = distance;
+            }
 
-    start = omp_get_wtime();
+            if (0.5 * distance < halfNearest[i]) {
+                halfNearest[i] = 0.5 * distance;
+            }
+            if (0.5 * distance < halfNearest[j]) {
+                halfNearest[j] = 0.5 * distance;
+            }
+        }
+    }
+}
 
-    log_debug("Running k-means with k=%d and maxIter=%d...", k, maxIter);
+double computeInertia(Dataframe *df, double *centroids, int k) {
+    double inertia = 0.0;
+    const int chunkRows = streamChunkRows(df);
+
+    for (int chunk = 0; chunk < df->maxRows; chunk += chunkRows) {
+        int chunkEnd = df->maxRows - chunk < chunkRows ? df->maxRows : chunk + chunkRows;
+        prefetchRows(df, chunkEnd, chunkRows);
+
+        #pragma omp parallel for schedule(static) reduction(+:inertia)
+        for (int i = chunk; i < chunkEnd; i++) {
+            const double *row = dfRow(df, i);
+            double minDistance = INFINITY;
+            for (int j = 0; j < k; j++) {
+                minDistance = fmin(
+                    minDistance,
+                    euclideanDistance(row, centroids + j * df->stride, df->numFeatures)
+                );
+            }
+            inertia += minDistance * minDistance;
+        }
 
-    double **centroids = initCentroids(df, k, expNumber);
+        releaseRows(df, chunk, chunkEnd - chunk);
+    }
 
-    // TODO: separate function to allocate memory for prevCentroids
-    double **prevCentroids = malloc(k * sizeof(double *));
-    for (int i = 0; i < k; i++) {
-        prevCentroids[i] = malloc(df->numFeatures * sizeof(double));
+    return inertia;
+}
+
+void centroidDrift(Dataframe *df, double *centroids, double *prevCentroids, int k, double *drift) {
+    for (int j = 0; j < k; j++) {
+        drift[j] = euclideanDistance(
+            centroids + j * df->stride, prevCentroids + j * df->stride, df->numFeatures
+        );
     }
+}
 
-    int *assignments = NULL;
+static void lloyd(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    int maxIter,
+    Experiment *exp,
+    int debug,
+    Workspace *ws,
+    const KmeansConfig *config
+) {
     int iteration = 0;
 
+    // the sweeps read a private copy of the rows that's sorted by cluster
+    // every reorderInterval iterations, see reorder.c
+    ClusterOrder *order = NULL;
+    long long changedSinceSort = 0;
+    if (config->reorderInterval > 0) {
+        order = allocClusterOrder(df, k, ws->assignments, &ws->arena);
+        df = &order->rows;
+    }
+
     while(maxIter > 0)
     {
-        assignments = initAssignments(df, centroids, k);
+        assignAndAccumulate(df, centroids, k, ws, config->precision);
+        exp->distanceCount += (long long)df->maxRows * k;
+        exp->changedPoints += ws->changed;
+        log_debug("%lld points changed cluster", ws->changed);
 
         if(debug) {
-            saveIterationData(centroids, assignments, df, k, iteration, expNumber);
+            saveIterationData(centroids, ws->assignments, df, k, iteration, exp->number);
         }
 
-        // save previous centroids before updating
-        for (int i = 0; i < k; i++) {
-            for (int j = 0; j < df->numFeatures; j++) {
-                prevCentroids[i][j] = centroids[i][j];
-            }
+        // the running sums don't depend on the order of the rows, so delta
+        // sweeps carry on across a sort
+        changedSinceSort += ws->changed;
+        if (
+            order != NULL
+            && (iteration + 1) % config->reorderInterval == 0
+            && changedSinceSort >= REORDER_MIN_CHANGED * df->maxRows
+        ) {
+            sortByCluster(order, &ws->assignments, k);
+            changedSinceSort = 0;
         }
-        updateCentroids(df, centroids, assignments, k);
 
-        if (hasConverged(centroids, prevCentroids, k, df->numFeatures, CONVERGENCE_THRESHOLD)) {
+        // save previous centroids before updating
+        memcpy(ws->prevCentroids, centroids, (size_t)k * df->stride * sizeof(double));
+        applyThreadSums(df, centroids, k, ws);
+
+        if (hasConverged(
+            centroids, ws->prevCentroids, k, df->numFeatures, df->stride, CONVERGENCE_THRESHOLD
+        )) {
             log_debug("Convergence achieved after %d iterations.", iteration + 1);
             break;
         }
@@ -231,18 +549,171 @@ void kmeans(Dataframe *df, Experiment *exp, int k, int maxIter, int expNumber, i
         iteration++;
     }
 
+    exp->convergenceIteration = iteration;
+
+    if (order != NULL) {
+        freeClusterOrder(order);
+    }
+}
+
+const char *algorithmName(Algorithm algorithm) {
+    switch (algorithm) {
+        case ALGORITHM_ELKAN:
+            return "elkan";
+        case ALGORITHM_HAMERLY:
+            return "hamerly";
+        case ALGORITHM_YINYANG:
+            return "yinyang";
+        case ALGORITHM_MINIBATCH:
+            return "minibatch";
+        case ALGORITHM_KDTREE:
+            return "kdtree";
+        case ALGORITHM_LLOYD:
+        default:
+            return "lloyd";
+    }
+}
+
+int parseAlgorithm(const char *name, Algorithm *algorithm) {
+    if (strcmp(name, "lloyd") == 0) {
+        *algorithm = ALGORITHM_LLOYD;
+    } else if (strcmp(name, "elkan") == 0) {
+        *algorithm = ALGORITHM_ELKAN;
+    } else if (strcmp(name, "hamerly") == 0) {
+        *algorithm = ALGORITHM_HAMERLY;
+    } else if (strcmp(name, "yinyang") == 0) {
+        *algorithm = ALGORITHM_YINYANG;
+    } else if (strcmp(name, "minibatch") == 0) {
+        *algorithm = ALGORITHM_MINIBATCH;
+    } else if (strcmp(name, "kdtree") == 0) {
+        *algorithm = ALGORITHM_KDTREE;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+const char *initializationName(Initialization init) {
+    switch (init) {
+        case INIT_KMEANS_PLUS_PLUS:
+            return "kmeans++";
+        case INIT_KMEANS_PARALLEL:
+            return "kmeans||";
+        case INIT_RANDOM:
+        default:
+            return "random";
+    }
+}
+
+int parseInitialization(const char *name, Initialization *init) {
+    if (strcmp(name, "random") == 0) {
+        *init = INIT_RANDOM;
+    } else if (strcmp(name, "kmeans++") == 0) {
+        *init = INIT_KMEANS_PLUS_PLUS;
+    } else if (strcmp(name, "kmeans||") == 0) {
+        *init = INIT_KMEANS_PARALLEL;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+const char *precisionName(Precision precision) {
+    switch (precision) {
+        case PRECISION_FLOAT:
+            return "float";
+        case PRECISION_INT16:
+            return "int16";
+        case PRECISION_DOUBLE:
+        default:
+            return "double";
+    }
+}
+
+int parsePrecision(const char *name, Precision *precision) {
+    if (strcmp(name, "double") == 0) {
+        *precision = PRECISION_DOUBLE;
+    } else if (strcmp(name, "float") == 0) {
+        *precision = PRECISION_FLOAT;
+    } else if (strcmp(name, "int16") == 0) {
+        *precision = PRECISION_INT16;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+void kmeans(
+    Dataframe *df,
+    Experiment *exp,
+    int k,
+    int maxIter,
+    int expNumber,
+    int debug,
+    const KmeansConfig *config
+) {
+    double start, end;
+    double wall_time_used;
+
+    start = omp_get_wtime();
+
+    log_debug(
+        "Running %s k-means with %s seeding, k=%d and maxIter=%d...",
+        algorithmName(config->algorithm), initializationName(config->init), k, maxIter
+    );
+
+    exp->number = expNumber;
+    exp->algorithm = config->algorithm;
+    exp->init = config->init;
+    exp->precision = config->precision;
+    exp->isa = resolveIsa(config->isa);
+    exp->distanceCount = 0;
+    exp->changedPoints = 0;
+
+    double *centroids = initCentroids(df, k, config->seed + expNumber, config->init);
+    // the k rows the seeding read from a mapped dataframe are dropped before
+    // the sweeps start streaming
+    releaseRows(df, 0, df->maxRows);
+    // every scratch buffer of the run is allocated once here and reused
+    Workspace *ws = allocWorkspace(df, k, config->isa, 1);
+
+    switch (config->algorithm) {
+        case ALGORITHM_ELKAN:
+            elkan(df, centroids, k, maxIter, exp, debug, ws);
+            break;
+        case ALGORITHM_HAMERLY:
+            hamerly(df, centroids, k, maxIter, exp, debug, ws);
+            break;
+        case ALGORITHM_YINYANG:
+            yinyang(df, centroids, k, maxIter, exp, debug, ws);
+            break;
+        case ALGORITHM_MINIBATCH:
+            minibatch(df, centroids, k, maxIter, exp, debug, ws, config);
+            break;
+        case ALGORITHM_KDTREE:
+            // a tree without splits would only add the filtering to lloyd
+            if (config->kdtree != NULL) {
+                kdtreeFiltering(df, config->kdtree, centroids, k, maxIter, exp, debug, ws);
+            } else {
+                lloyd(df, centroids, k, maxIter, exp, debug, ws, config);
+            }
+            break;
+        case ALGORITHM_LLOYD:
+        default:
+            lloyd(df, centroids, k, maxIter, exp, debug, ws, config);
+            break;
+    }
+
     end = omp_get_wtime();
     wall_time_used = end - start;
 
-    exp->convergenceIteration = iteration;
     exp->executionTime = wall_time_used;
-    exp->number = expNumber;
 
-    for (int i = 0; i < k; i++) {
-        free(centroids[i]);
-    }
+    // not timed, it's only there to compare the quality of the variants
+    exp->inertia = computeInertia(df, centroids, k);
+
     free(centroids);
-    free(assignments);
+    freeWorkspace(ws);
 
     log_debug("K-means completed!");
 }
@@ -0,0 +1,174 @@
+/*
+Lockstep restarts of Lloyd's algorithm.
+
+Running numExp experiments back to back streams the whole dataset numExp
+times per iteration, which for the large datasets is bound by memory
+bandwidth. In lockstep every experiment is a restart with its own centroids,
+and they all advance together:
+
+   while some restart is still running:
+       for each block of rows:               <- read from memory once
+           for each running restart r:       <- block still in cache
+               assign the block to the centroids of r, add it to the sums of r
+       for each running restart r:
+           move the centroids of r, stop r if it converged
+
+Each restart keeps its own convergence state and Experiment record, and
+produces the same centroids it would in a separate kmeans() call with the same
+seed. The time of a restart is its own seeding and updates plus an equal share
+of every sweep it took part in, so the times of the restarts add up to the
+time of the run.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../include/log.h"
+#include "../include/helper.h"
+#include "../include/experiments.h"
+#include "../include/distance.h"
+#include "../include/kmeans.h"
+#include "../include/lockstep.h"
+
+typedef struct {
+    double *centroids;
+    Workspace *ws;
+    Experiment *exp;
+    int running;
+    int maxIter; // iterations left
+} Restart;
+
+void kmeansLockstep(
+    Dataframe *df,
+    Experiment *experiments,
+    int numExp,
+    int k,
+    int maxIter,
+    int debug,
+    const KmeansConfig *config
+) {
+    log_debug(
+        "Running %d %s k-means restarts in lockstep with %s seeding, k=%d and maxIter=%d...",
+        numExp, algorithmName(config->algorithm), initializationName(config->init), k, maxIter
+    );
+
+    Restart *restarts = malloc(numExp * sizeof(Restart));
+    for (int r = 0; r < numExp; r++) {
+        Experiment *exp = &experiments[r];
+        exp->number = r;
+        exp->algorithm = config->algorithm;
+        exp->init = config->init;
+        exp->precision = config->precision;
+        exp->isa = resolveIsa(config->isa);
+        exp->schedule = SCHEDULE_DATA;
+        exp->distanceCount = 0;
+        exp->changedPoints = 0;
+        exp->convergenceIteration = 0;
+
+        double seedStart = omp_get_wtime();
+        restarts[r].centroids = initCentroids(df, k, config->seed + r, config->init);
+        // the assignments let every restart count the points that changed
+        // cluster and run the delta sweeps of plain lloyd
+        restarts[r].ws = allocWorkspace(df, k, config->isa, 1);
+        exp->executionTime = omp_get_wtime() - seedStart;
+        restarts[r].exp = exp;
+        restarts[r].running = maxIter > 0;
+        restarts[r].maxIter = maxIter;
+    }
+
+    int numBlocks = (df->maxRows + ASSIGN_BLOCK_ROWS - 1) / ASSIGN_BLOCK_ROWS;
+    // indices of the restarts still running, so finished ones cost nothing
+    int *running = malloc(numExp * sizeof(int));
+    int numRunning = 0;
+    for (int r = 0; r < numExp; r++) {
+        if (restarts[r].running) {
+            running[numRunning++] = r;
+        }
+    }
+
+    while (numRunning > 0) {
+        double sweepStart = omp_get_wtime();
+        log_debug("Assigning points for %d running restarts...", numRunning);
+        for (int i = 0; i < numRunning; i++) {
+            Restart *restart = &restarts[running[i]];
+            prepareAssignment(df, restart->centroids, k, restart->ws, config->precision);
+        }
+
+        #pragma omp parallel
+        {
+            int tid = omp_get_thread_num();
+
+            #pragma omp for schedule(static)
+            for (int block = 0; block < numBlocks; block++)
+            {
+                int begin = block * ASSIGN_BLOCK_ROWS;
+                int count = df->maxRows - begin < ASSIGN_BLOCK_ROWS
+                    ? df->maxRows - begin
+                    : ASSIGN_BLOCK_ROWS;
+
+                for (int i = 0; i < numRunning; i++) {
+                    Restart *restart = &restarts[running[i]];
+                    assignBlock(
+                        df, restart->centroids, k, restart->ws, config->precision,
+                        tid, begin, count
+                    );
+                }
+            }
+        }
+
+        // every running restart gets the same share of the sweep
+        double sweepShare = (omp_get_wtime() - sweepStart) / numRunning;
+
+        int stillRunning = 0;
+        for (int i = 0; i < numRunning; i++) {
+            double updateStart = omp_get_wtime();
+            Restart *restart = &restarts[running[i]];
+            Workspace *ws = restart->ws;
+            Experiment *exp = restart->exp;
+
+            exp->distanceCount += (long long)df->maxRows * k;
+            exp->changedPoints += ws->changed;
+            if (debug) {
+                saveIterationData(
+                    restart->centroids, ws->assignments, df, k,
+                    exp->convergenceIteration, exp->number
+                );
+            }
+
+            memcpy(ws->prevCentroids, restart->centroids, (size_t)k * df->stride * sizeof(double));
+            applyThreadSums(df, restart->centroids, k, ws);
+
+            if (hasConverged(
+                restart->centroids, ws->prevCentroids, k, df->numFeatures, df->stride,
+                CONVERGENCE_THRESHOLD
+            )) {
+                log_debug("Restart %d converged after %d iterations.", exp->number, exp->convergenceIteration + 1);
+                restart->running = 0;
+            } else if (--restart->maxIter == 0) {
+                restart->running = 0;
+                exp->convergenceIteration++;
+            } else {
+                exp->convergenceIteration++;
+            }
+
+            if (restart->running) {
+                running[stillRunning++] = running[i];
+            }
+            exp->executionTime += sweepShare + omp_get_wtime() - updateStart;
+        }
+        numRunning = stillRunning;
+    }
+
+    for (int r = 0; r < numExp; r++) {
+        // not timed, it's only there to compare the quality of the restarts
+        restarts[r].exp->inertia = computeInertia(df, restarts[r].centroids, k);
+        free(restarts[r].centroids);
+        freeWorkspace(restarts[r].ws);
+    }
+
+    free(running);
+    free(restarts);
+
+    log_debug("Lockstep k-means completed!");
+}
@@ -1,42 +1,299 @@
 #include <stdlib.h>
 #include <math.h>
 #include <time.h>
+#include <getopt.h>
+#include <omp.h>
 #include "../include/log.h"
 #include "../include/helper.h"
+#include "../include/distance.h"
 #include "../include/kmeans.h"
+#include "../include/lockstep.h"
+#include "../include/schedule.h"
 #include "../include/dataset.h"
+#include "../include/binary.h"
 #include "../include/experiments.h"
+#include "../include/kdtree.h"
+
+static void printUsage(const char *program)
+{
+    fprintf(
+        stderr,
+        "Usage: %s [options] <dataset> <num_exp> <clusters> <max_iterations> [debug]\n",
+        program
+    );
+    fprintf(stderr, "  dataset (str): dataset to use\n");
+    fprintf(stderr, "  num_exp (int+): number of experiments to run\n");
+    fprintf(
+        stderr, "  clusters (int+): k number of clusters to separate the data\n"
+    );
+    fprintf(
+        stderr, "  max_iterations (int+): Maximum number of iterations\n"
+        "if the algorithm does not converge\n"
+    );
+    fprintf(stderr, "  debug: 0 (off) or 1 (on), default is 0\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(
+        stderr,
+        "  -a, --algorithm <lloyd|elkan|hamerly|yinyang|minibatch|kdtree>: k-means variant, "
+        "default is lloyd\n"
+    );
+    fprintf(
+        stderr,
+        "  -i, --init <random|kmeans++|kmeans||>: centroid seeding, default is random\n"
+    );
+    fprintf(
+        stderr,
+        "  -p, --precision <double|float|int16>: precision of the assignment distances "
+        "(lloyd only), default is double\n"
+    );
+    fprintf(
+        stderr,
+        "  -x, --isa <auto|sse2|avx2|avx512>: instruction set of the assignment "
+        "kernels, default is auto (the widest the cpu supports)\n"
+    );
+    fprintf(
+        stderr,
+        "  -l, --lockstep: run the experiments as lloyd restarts that share every "
+        "sweep over the data\n"
+    );
+    fprintf(
+        stderr,
+        "  -S, --schedule <auto|data|experiments|nested>: spread the threads across "
+        "the rows, the experiments or both, default is auto\n"
+    );
+    fprintf(
+        stderr, "  -s, --seed <int>: experiment i is seeded with seed + i, default is the time\n"
+    );
+    fprintf(
+        stderr, "  -b, --batch-size <int+>: rows per mini-batch, default is %d\n",
+        DEFAULT_BATCH_SIZE
+    );
+    fprintf(
+        stderr,
+        "  -n, --max-no-improvement <int+>: mini-batches without inertia "
+        "improvement before stopping, default is %d\n",
+        DEFAULT_MAX_NO_IMPROVEMENT
+    );
+    fprintf(
+        stderr,
+        "  -r, --reorder <int+>: sort the rows by cluster every n iterations "
+        "(lloyd only), default is never\n"
+    );
+    fprintf(
+        stderr,
+        "  -o, --out-of-core: dataset is a binary file, streamed from disk on every "
+        "iteration (lloyd with random seeding only)\n"
+    );
+    fprintf(
+        stderr,
+        "  -w, --write-binary <path>: save the dataset as a binary file and exit, "
+        "only the dataset argument is needed\n"
+    );
+    fprintf(
+        stderr,
+        "  -H, --huge-pages: back the dataset and the buffers of every experiment "
+        "with 2 MB pages\n"
+    );
+    fprintf(
+        stderr,
+        "  -c, --columns <i,j,...>: 0 based columns of the dataset file to use as "
+        "features, default is the schema of the dataset\n"
+    );
+}
 
 int main(int argc, char *argv[])
 {
     int debug = 0; // debug off
+    int lockstep = 0;
+    int outOfCore = 0;
+    const char *binaryPath = NULL;
+    const char *columns = NULL;
+    KmeansConfig config = {
+        ALGORITHM_LLOYD,
+        INIT_RANDOM,
+        PRECISION_DOUBLE,
+        ISA_AUTO,
+        SCHEDULE_AUTO,
+        (uint64_t)time(NULL),
+        DEFAULT_BATCH_SIZE,
+        DEFAULT_MAX_NO_IMPROVEMENT,
+        0,
+        NULL
+    };
+
+    static struct option longOptions[] = {
+        {"algorithm", required_argument, NULL, 'a'},
+        {"init", required_argument, NULL, 'i'},
+        {"precision", required_argument, NULL, 'p'},
+        {"isa", required_argument, NULL, 'x'},
+        {"lockstep", no_argument, NULL, 'l'},
+        {"schedule", required_argument, NULL, 'S'},
+        {"seed", required_argument, NULL, 's'},
+        {"batch-size", required_argument, NULL, 'b'},
+        {"max-no-improvement", required_argument, NULL, 'n'},
+        {"reorder", required_argument, NULL, 'r'},
+        {"out-of-core", no_argument, NULL, 'o'},
+        {"write-binary", required_argument, NULL, 'w'},
+        {"columns", required_argument, NULL, 'c'},
+        {"huge-pages", no_argument, NULL, 'H'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "a:i:p:x:lS:s:b:n:r:ow:c:H", longOptions, NULL)) != -1)
+    {
+        switch (option)
+        {
+            case 'a':
+                if (!parseAlgorithm(optarg, &config.algorithm)) {
+                    fprintf(stderr, "Unknown algorithm: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'i':
+                if (!parseInitialization(optarg, &config.init)) {
+                    fprintf(stderr, "Unknown initialization: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'p':
+                if (!parsePrecision(optarg, &config.precision)) {
+                    fprintf(stderr, "Unknown precision: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'x':
+                if (!parseIsa(optarg, &config.isa)) {
+                    fprintf(stderr, "Unknown isa: %s\n", optarg);
+                    return 1;
+                }
+                if (!isaSupported(config.isa)) {
+                    fprintf(stderr, "Isa %s is not supported by this cpu\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'l':
+                lockstep = 1;
+                break;
+            case 'S':
+                if (!parseSchedule(optarg, &config.schedule)) {
+                    fprintf(stderr, "Unknown schedule: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 's':
+                config.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'b':
+                config.batchSize = atoi(optarg);
+                if (config.batchSize <= 0) {
+                    fprintf(stderr, "Batch size must be positive\n");
+                    return 1;
+                }
+                break;
+            case 'n':
+                config.maxNoImprovement = atoi(optarg);
+                if (config.maxNoImprovement <= 0) {
+                    fprintf(stderr, "Max no improvement must be positive\n");
+                    return 1;
+                }
+                break;
+            case 'r':
+                config.reorderInterval = atoi(optarg);
+                if (config.reorderInterval <= 0) {
+                    fprintf(stderr, "Reorder interval must be positive\n");
+                    return 1;
+                }
+                break;
+            case 'o':
+                outOfCore = 1;
+                break;
+            case 'w':
+                binaryPath = optarg;
+                break;
+            case 'c':
+                columns = optarg;
+                break;
+            case 'H':
+                setHugePages(1);
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (config.precision != PRECISION_DOUBLE && config.algorithm != ALGORITHM_LLOYD) {
+        fprintf(stderr, "Precision %s is only supported by lloyd\n", precisionName(config.precision));
+        return 1;
+    }
+
+    if (lockstep && config.algorithm != ALGORITHM_LLOYD) {
+        fprintf(stderr, "Lockstep is only supported by lloyd\n");
+        return 1;
+    }
+    if (config.reorderInterval > 0 && (config.algorithm != ALGORITHM_LLOYD || lockstep)) {
+        fprintf(stderr, "Reordering the rows is only supported by lloyd without lockstep\n");
+        return 1;
+    }
+    if (lockstep && config.schedule != SCHEDULE_AUTO && config.schedule != SCHEDULE_DATA) {
+        fprintf(stderr, "Lockstep restarts share every sweep, only the data schedule applies\n");
+        return 1;
+    }
+
+    // streaming only bounds the rows, the bounded variants keep more per row
+    // than the rows themselves and the other precisions a copy of them
+    if (
+        outOfCore
+        && (
+            config.algorithm != ALGORITHM_LLOYD || config.precision != PRECISION_DOUBLE
+            || lockstep || config.reorderInterval > 0
+        )
+    ) {
+        fprintf(stderr, "Out-of-core runs only support lloyd in double precision\n");
+        return 1;
+    }
+    if (outOfCore && config.schedule != SCHEDULE_AUTO && config.schedule != SCHEDULE_DATA) {
+        fprintf(stderr, "Out-of-core experiments stream the file one at a time, only the data schedule applies\n");
+        return 1;
+    }
+    // kmeans++ and kmeans|| keep a distance per row and read the rows between
+    // the chunks of a sweep, so only random seeding stays within a few chunks
+    if (outOfCore && config.init != INIT_RANDOM) {
+        fprintf(stderr, "Out-of-core runs only support random seeding\n");
+        return 1;
+    }
+    if (outOfCore && columns != NULL) {
+        fprintf(stderr, "Columns can only be selected from a text dataset\n");
+        return 1;
+    }
 
-    if (argc < 5 || argc > 7)
+    int numArgs = argc - optind;
+    if (binaryPath != NULL && numArgs >= 1) {
+        log_set_quiet("root", true);
+        log_add_stream_handler(DEFAULT, LOG_INFO, "console");
+        log_info("loading %s dataset...", argv[optind]);
+        Dataframe df = loadDataset(argv[optind], columns);
+        int written = writeBinaryDataset(&df, binaryPath, NULL, 0);
+        if (written) {
+            log_info("Saved %s to %s", df.name, binaryPath);
+        }
+        freeDataframe(&df);
+        return written ? 0 : 1;
+    }
+    if (numArgs < 4 || numArgs > 5)
     {
-        fprintf(
-            stderr,
-            "Usage: %s <dataset> <num_exp> <clusters> <max_iterations> [debug]\n",
-            argv[0]
-        );
-        fprintf(stderr, "  dataset (str): dataset to use\n");
-        fprintf(stderr, "  num_exp (int+): number of experiments to run\n");
-        fprintf(
-            stderr, "  clusters (int+): k number of clusters to separate the data\n"
-        );
-        fprintf(
-            stderr, "  max_iterations (int+): Maximum number of iterations\n"
-            "if the algorithm does not converge\n"
-        );
-        fprintf(stderr, "  debug: 0 (off) or 1 (on), default is 0\n");
+        printUsage(argv[0]);
         return 1;
     }
 
-    char *dataset = argv[1];
-    int numExp = atoi(argv[2]); // number of experiments
-    int k = atoi(argv[3]); // clusters
-    int maxIter = atoi(argv[4]);
-    if (argc >= 5) {
-        debug = atoi(argv[5]);
+    char **args = argv + optind;
+    char *dataset = args[0];
+    int numExp = atoi(args[1]); // number of experiments
+    int k = atoi(args[2]); // clusters
+    int maxIter = atoi(args[3]);
+    if (numArgs == 5) {
+        debug = atoi(args[4]);
         if (debug != 0 && debug != 1) {
             fprintf(stderr, "Debug must be 0 or 1\n");
             return 1;
@@ -54,14 +311,47 @@ int main(int argc, char *argv[])
 
     Experiment *experiments = malloc((numExp) * sizeof(*experiments));
 
+    detectCacheSizes();
     log_info("loading %s dataset...", dataset);
-    Dataframe df = loadDataset(dataset);
+    Dataframe df;
+    if (outOfCore) {
+        if (!mapBinaryDataset(dataset, NULL, 0, &df)) {
+            free(experiments);
+            return 1;
+        }
+        streamDataset(&df);
+    } else {
+        df = loadDataset(dataset, columns);
+    }
+    if (config.precision == PRECISION_FLOAT) {
+        buildFloatStorage(&df);
+    } else if (config.precision == PRECISION_INT16) {
+        if (!buildInt16Storage(&df)) {
+            log_error("Precision int16 needs a dataset with integer values only");
+            freeDataframe(&df);
+            free(experiments);
+            return 1;
+        }
+        log_debug("Quantized %s to int16 with a shift of %d bits", df.name, df.shiftI16);
+    }
     log_info("Dataset loaded!");
 
+    // the tree only depends on the rows, so the experiments share one and
+    // their times leave out the build. Rows that fit a single leaf are
+    // clustered by lloyd's sweeps instead
+    if (config.algorithm == ALGORITHM_KDTREE && df.maxRows <= KDTREE_LEAF_SIZE) {
+        log_info("%s fits in a single kd-tree leaf, running lloyd's sweeps", df.name);
+    } else if (config.algorithm == ALGORITHM_KDTREE) {
+        double buildStart = omp_get_wtime();
+        config.kdtree = buildKdTree(&df);
+        log_info("Kd-tree built in %f", omp_get_wtime() - buildStart);
+    }
+
     log_info("Running k-means...");
-    for(int i = 0; i < numExp; i++){
-        log_debug("Running experiment %d...\n", i);
-        kmeans(&df, &experiments[i], k, maxIter, i, debug);
+    if (lockstep) {
+        kmeansLockstep(&df, experiments, numExp, k, maxIter, debug, &config);
+    } else {
+        runExperiments(&df, experiments, numExp, k, maxIter, debug, &config);
     }
     log_info("k-means finished!");
 
@@ -74,13 +364,11 @@ int main(int argc, char *argv[])
     }
 
     log_debug("Freeing memory...");
-    for (int i = 0; i < df.maxRows; i++)
-    {
-        if (df.data[i] != NULL)
-        {
-            free(df.data[i]);
-        }
+    if (config.kdtree != NULL) {
+        freeKdTree(config.kdtree);
     }
+    freeDataframe(&df);
+    free(experiments);
 
     return 0;
 }
@@ -0,0 +1,171 @@
+/*
+Mini-batch K-Means (Sculley, 2010):
+
+Instead of sweeping every row, each iteration samples a batch of b rows,
+assigns them to their nearest centroid and moves each centroid towards the
+mean of its batch points with a per-centroid learning rate
+
+   eta_c = b_c / (n_c + b_c)
+
+where b_c is the number of batch points assigned to c and n_c the number of
+points c has absorbed so far, so centroids settle as they see more data.
+
+The algorithm stops when the exponentially weighted average of the batch
+inertia hasn't improved for maxNoImprovement batches, when the centroids stop
+moving, or after maxIter batches.
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+#include <string.h>
+
+#include "../include/log.h"
+#include "../include/helper.h"
+#include "../include/experiments.h"
+#include "../include/distance.h"
+#include "../include/kmeans.h"
+#include "../include/minibatch.h"
+
+// full assignment, only used to save the iteration data in debug mode
+static void assignAll(Dataframe *df, double *centroids, int k, Assignments assignments) {
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < df->maxRows; i++) {
+        const double *row = dfRow(df, i);
+        double minDistance = INFINITY;
+        int closestCentroid = 0;
+        for (int j = 0; j < k; j++) {
+            double distance = euclideanDistance(row, centroids + j * df->stride, df->numFeatures);
+            if (distance < minDistance) {
+                minDistance = distance;
+                closestCentroid = j;
+            }
+        }
+        setAssignment(assignments, i, closestCentroid);
+    }
+}
+
+void minibatch(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    int maxIter,
+    Experiment *exp,
+    int debug,
+    Workspace *ws,
+    const KmeansConfig *config
+) {
+    int n = df->maxRows;
+    int batchSize = config->batchSize < n ? config->batchSize : n;
+
+    int *batch = arenaAlloc(&ws->arena, batchSize * sizeof(int));
+    int *batchAssignments = arenaAlloc(&ws->arena, batchSize * sizeof(int));
+    long long *seen = arenaAlloc(&ws->arena, k * sizeof(long long));
+    int *batchCounts = arenaAlloc(&ws->arena, k * sizeof(int));
+    double *batchSums = arenaAlloc(&ws->arena, (size_t)k * df->stride * sizeof(double));
+    double *prevCentroids = ws->prevCentroids;
+    Assignments assignments = ws->assignments;
+
+    // a different stream than the one used to seed the centroids
+    uint64_t rng = (config->seed + exp->number) * 0x9E3779B97F4A7C15ULL;
+
+    // smoothing factor of the inertia average, a batch weighs b / n of a full pass
+    double alpha = fmin(1.0, 2.0 * batchSize / (n + 1.0));
+    double ewaInertia = -1.0;
+    double bestInertia = INFINITY;
+    int noImprovement = 0;
+
+    long long distances = 0;
+    int iteration = 0;
+
+    while (maxIter > 0)
+    {
+        for (int b = 0; b < batchSize; b++) {
+            batch[b] = (int)(nextRandom(&rng) % n);
+        }
+
+        double batchInertia = 0.0;
+
+        #pragma omp parallel for schedule(static) reduction(+:batchInertia)
+        for (int b = 0; b < batchSize; b++) {
+            const double *row = dfRow(df, batch[b]);
+            double minDistance = INFINITY;
+            int closestCentroid = 0;
+            for (int j = 0; j < k; j++) {
+                double distance = euclideanDistance(row, centroids + j * df->stride, df->numFeatures);
+                if (distance < minDistance) {
+                    minDistance = distance;
+                    closestCentroid = j;
+                }
+            }
+            batchAssignments[b] = closestCentroid;
+            batchInertia += minDistance * minDistance;
+        }
+        distances += (long long)batchSize * k;
+
+        if(debug) {
+            assignAll(df, centroids, k, assignments);
+            saveIterationData(centroids, assignments, df, k, iteration, exp->number);
+        }
+
+        // a batch is small, summing it serially is cheaper than a reduction
+        memset(batchCounts, 0, k * sizeof(int));
+        memset(batchSums, 0, (size_t)k * df->stride * sizeof(double));
+        for (int b = 0; b < batchSize; b++) {
+            const double *row = dfRow(df, batch[b]);
+            double *sum = batchSums + batchAssignments[b] * df->stride;
+            batchCounts[batchAssignments[b]]++;
+            for (int l = 0; l < df->numFeatures; l++) {
+                sum[l] += row[l];
+            }
+        }
+
+        memcpy(prevCentroids, centroids, (size_t)k * df->stride * sizeof(double));
+        for (int j = 0; j < k; j++) {
+            if (batchCounts[j] == 0) {
+                continue;
+            }
+
+            seen[j] += batchCounts[j];
+            double eta = (double)batchCounts[j] / seen[j];
+            double *centroid = centroids + j * df->stride;
+            const double *sum = batchSums + j * df->stride;
+            for (int l = 0; l < df->numFeatures; l++) {
+                centroid[l] += eta * (sum[l] / batchCounts[j] - centroid[l]);
+            }
+        }
+
+        batchInertia /= batchSize;
+        ewaInertia = ewaInertia < 0.0
+            ? batchInertia
+            : ewaInertia * (1.0 - alpha) + batchInertia * alpha;
+        log_debug(
+            "Batch %d: inertia %f, smoothed %f", iteration, batchInertia, ewaInertia
+        );
+
+        if (hasConverged(
+            centroids, prevCentroids, k, df->numFeatures, df->stride, CONVERGENCE_THRESHOLD
+        )) {
+            log_debug("Convergence achieved after %d iterations.", iteration + 1);
+            break;
+        }
+
+        if (ewaInertia < bestInertia) {
+            bestInertia = ewaInertia;
+            noImprovement = 0;
+        } else if (++noImprovement >= config->maxNoImprovement) {
+            log_debug(
+                "Inertia plateaued after %d iterations (%.3f passes over the data).",
+                iteration + 1,
+                (double)(iteration + 1) * batchSize / n
+            );
+            break;
+        }
+
+        log_debug("Max iterations left: %d", --maxIter);
+        iteration++;
+    }
+
+    exp->convergenceIteration = iteration;
+    exp->distanceCount += distances;
+}
@@ -0,0 +1,658 @@
+/*
+Parallel parser for the delimited text datasets:
+
+The file is memory-mapped and the data part, after the header lines, is split
+into one chunk per thread. Each chunk boundary is moved forward to the start of
+the next line, so every line belongs to exactly one chunk:
+
+   1. every thread counts the lines of its chunk
+   2. a prefix sum gives the first row of every chunk, and the matrix is
+      allocated for all the lines at once
+   3. every thread parses its lines into its rows, skipping the lines that
+      don't have numFeatures numbers where expected
+   4. the rows of each chunk are moved down over the rows skipped before it,
+      and the number of lines skipped that way is logged as a warning
+
+Lines can end in \n or \r\n, blank and comment lines are skipped. Only the
+fields of the columns selected are converted, the others are only stepped
+over, and a line stops being read after its last selected field, see
+parseDelimitedRow.
+
+The fields are converted by parseNumber instead of strtod, which spends most
+of its time on locale and format handling. It reads the digits into a 64 bit
+integer m and the decimal exponent e of the field, x = m * 10^e, and:
+
+   - integers, like the WESAD channels, are m itself
+   - when m < 2^53 and |e| <= 22, m and 10^|e| are both exact doubles, so
+     one multiplication or division rounds x correctly (Clinger's fast path)
+   - anything else, more than 19 digits, larger exponents, inf or nan, goes
+     to strtod in the C locale
+   - a field the fast path doesn't read whole, like a hexadecimal float, is
+     read again by strtod before the line is rejected
+
+so every field strtod reads is read, to the same correctly rounded double,
+whatever the locale of the process.
+
+inferDelimitedSchema guesses the format of a file from its first lines, for
+the files that aren't one of the built-in datasets:
+
+   - ARFF files are told by their @attribute lines, which name the columns
+     and give their types, the data follows @data and comments start with %
+   - otherwise the delimiter is whichever of tab, ; and , the first line has
+     the most of, and the first line is a header if any of its fields isn't
+     a number. Lines starting with # or % before it are comments
+
+and every numeric column is selected, the last other one is the label.
+*/
+
+// strtod_l and newlocale
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <locale.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <omp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../include/log.h"
+#include "../include/helper.h"
+#include "../include/parser.h"
+
+// start of the line after the one p is in, or end
+static const char *nextLine(const char *p, const char *end) {
+    const char *newline = memchr(p, '\n', end - p);
+    return newline != NULL ? newline + 1 : end;
+}
+
+// first line start at or after p, assuming a line starts at begin
+static const char *lineStart(const char *begin, const char *p, const char *end) {
+    if (p <= begin || p[-1] == '\n') {
+        return p;
+    }
+    return nextLine(p, end);
+}
+
+// powers of ten exactly representable as doubles
+static const double exactPowers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static locale_t cLocale = (locale_t)0;
+static pthread_once_t cLocaleOnce = PTHREAD_ONCE_INIT;
+
+static void createCLocale(void) {
+    cLocale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+}
+
+// the fields that don't take the fast path, copied so that strtod never
+// reads past the end of the mapping
+static double parseSlow(const char *p, const char *end, const char **after) {
+    char field[128];
+    size_t length = end - p < (long)sizeof(field) - 1 ? (size_t)(end - p) : sizeof(field) - 1;
+    memcpy(field, p, length);
+    field[length] = '\0';
+
+    char *fieldEnd;
+    double value;
+    pthread_once(&cLocaleOnce, createCLocale);
+    if (cLocale != (locale_t)0) {
+        value = strtod_l(field, &fieldEnd, cLocale);
+    } else {
+        value = strtod(field, &fieldEnd);
+    }
+    *after = p + (fieldEnd - field);
+    return value;
+}
+
+// parses the number at p, *after is p if there is none. Leading spaces are
+// skipped like strtod does
+static double parseNumber(const char *p, const char *end, const char **after) {
+    const char *start = p;
+    while (p < end && *p == ' ') {
+        p++;
+    }
+
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0; // significant digits read into the mantissa
+    int exponent = 0;
+    int anyDigit = 0;
+
+    // leading zeros don't count towards the 19 digits that fit
+    while (p < end && *p == '0') {
+        p++;
+        anyDigit = 1;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+        } else {
+            exponent++;
+        }
+        digits++;
+        p++;
+        anyDigit = 1;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        if (digits == 0) {
+            while (p < end && *p == '0') {
+                exponent--;
+                p++;
+                anyDigit = 1;
+            }
+        }
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+            digits++;
+            p++;
+            anyDigit = 1;
+        }
+    }
+    if (!anyDigit) {
+        // inf, nan, hexadecimal or not a number at all
+        return parseSlow(start, end, after);
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        int exponentNegative = 0;
+        if (q < end && (*q == '-' || *q == '+')) {
+            exponentNegative = *q == '-';
+            q++;
+        }
+        if (q < end && *q >= '0' && *q <= '9') {
+            int written = 0;
+            while (q < end && *q >= '0' && *q <= '9') {
+                if (written < 100000) {
+                    written = written * 10 + (*q - '0');
+                }
+                q++;
+            }
+            exponent += exponentNegative ? -written : written;
+            p = q;
+        }
+    }
+
+    if (digits > 19 || mantissa > (1ULL << 53) || exponent < -22 || exponent > 22) {
+        return parseSlow(start, end, after);
+    }
+
+    double value = (double)mantissa;
+    if (exponent < 0) {
+        value /= exactPowers[-exponent];
+    } else if (exponent > 0) {
+        value *= exactPowers[exponent];
+    }
+    *after = p;
+    return negative ? -value : value;
+}
+
+// the end of the number read up to after if it's the whole field, NULL if
+// something else follows it
+static const char *fieldEnd(const char *p, const char *after, const char *end, char delimiter) {
+    while (after < end && (*after == ' ' || *after == '\r')) {
+        after++;
+    }
+    if (after == p || (after < end && *after != delimiter && *after != '\n')) {
+        return NULL;
+    }
+    return after;
+}
+
+// parses the selected columns of the line starting at p into values, in the
+// order of format->columns. Returns 0 if the line doesn't have them all as
+// numbers
+int parseDelimitedRow(const char *p, const char *end, const DelimitedFormat *format, double *values) {
+    int column = 0;
+    int parsed = 0;
+
+    while (parsed < format->numColumns && p < end && *p != '\n') {
+        if (column == format->columns[parsed]) {
+            const char *after;
+            values[parsed] = parseNumber(p, end, &after);
+            // the whole field has to be the number, strtod gets a second look
+            // at the forms the fast path stops early in
+            const char *field = fieldEnd(p, after, end, format->delimiter);
+            if (field == NULL) {
+                values[parsed] = parseSlow(p, end, &after);
+                field = fieldEnd(p, after, end, format->delimiter);
+            }
+            if (field == NULL) {
+                return 0;
+            }
+            after = field;
+            parsed++;
+            p = after;
+        } else {
+            while (p < end && *p != format->delimiter && *p != '\n') {
+                p++;
+            }
+        }
+
+        if (p < end && *p == format->delimiter) {
+            p++;
+        }
+        column++;
+    }
+
+    return parsed == format->numColumns;
+}
+
+static int isSkipped(const char *p, const char *end, char comment) {
+    if (comment != 0 && p < end && *p == comment) {
+        return 1;
+    }
+    while (p < end && *p != '\n') {
+        if (*p != ' ' && *p != '\t' && *p != '\r') {
+            return 0;
+        }
+        p++;
+    }
+    return 1;
+}
+
+// returns the number of rows parsed into *rows, a matrix of stride doubles
+// per row allocated from arena, exits if the file can't be read like the loaders.
+// The matrix is sized from the number of lines, so it holds every row
+// without growing
+int parseDelimitedFile(const char *path, const DelimitedFormat *format, int stride, Arena *arena, double **rows) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Error while opening the file");
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        perror("Error while reading the file");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t size = info.st_size;
+    const char *text = NULL;
+    if (size > 0) {
+        text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED) {
+            perror("Error while mapping the file");
+            exit(EXIT_FAILURE);
+        }
+        madvise((void *)text, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    const char *end = text + size;
+    const char *data = text;
+    for (int i = 0; i < format->skipLines && data < end; i++) {
+        data = nextLine(data, end);
+    }
+    if (format->endOfHeader != NULL) {
+        size_t markerLength = strlen(format->endOfHeader);
+        const char *line = data;
+        while (line < end) {
+            const char *next = nextLine(line, end);
+            if ((size_t)(end - line) >= markerLength && strncasecmp(line, format->endOfHeader, markerLength) == 0) {
+                data = next;
+                break;
+            }
+            line = next;
+        }
+    }
+
+    int numThreads = omp_get_max_threads();
+    int *chunkRows = calloc(numThreads + 1, sizeof(int));
+    int *chunkParsed = calloc(numThreads, sizeof(int));
+    int rejected = 0; // lines that are neither rows nor skipped
+    double *matrix = NULL;
+
+    #pragma omp parallel num_threads(numThreads) reduction(+:rejected)
+    {
+        int team = omp_get_num_threads();
+        int tid = omp_get_thread_num();
+        size_t length = end - data;
+        const char *begin = lineStart(data, data + length * tid / team, end);
+        const char *chunkEnd = lineStart(data, data + length * (tid + 1) / team, end);
+
+        int lines = 0;
+        for (const char *line = begin; line < chunkEnd; line = nextLine(line, chunkEnd)) {
+            lines++;
+        }
+        chunkRows[tid + 1] = lines;
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            for (int t = 0; t < team; t++) {
+                chunkRows[t + 1] += chunkRows[t];
+            }
+            matrix = arenaAlloc(arena, (size_t)chunkRows[team] * stride * sizeof(double));
+        }
+
+        int parsed = 0;
+        double *chunkMatrix = matrix + (size_t)chunkRows[tid] * stride;
+        for (const char *line = begin; line < chunkEnd; line = nextLine(line, chunkEnd)) {
+            if (isSkipped(line, chunkEnd, format->comment)) {
+                continue;
+            }
+            if (parseDelimitedRow(line, chunkEnd, format, chunkMatrix + (size_t)parsed * stride)) {
+                parsed++;
+            } else {
+                rejected++;
+            }
+        }
+        chunkParsed[tid] = parsed;
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            // the chunks are moved in order, so a chunk never overwrites
+            // rows that haven't been moved yet
+            int row = 0;
+            for (int t = 0; t < team; t++) {
+                if (row != chunkRows[t]) {
+                    memmove(
+                        matrix + (size_t)row * stride,
+                        matrix + (size_t)chunkRows[t] * stride,
+                        (size_t)chunkParsed[t] * stride * sizeof(double)
+                    );
+                }
+                row += chunkParsed[t];
+            }
+            chunkRows[0] = row;
+        }
+    }
+
+    if (rejected > 0) {
+        log_warn(
+            "Skipped %d lines of %s without a number in each of the %d columns",
+            rejected, path, format->numColumns
+        );
+    }
+
+    int numRows = chunkRows[0];
+    free(chunkRows);
+    free(chunkParsed);
+    if (text != NULL) {
+        munmap((void *)text, size);
+    }
+
+    *rows = matrix;
+    return numRows;
+}
+
+// a field is a number if strtod reads all of it
+static int isNumber(const char *field) {
+    char *after;
+    strtod(field, &after);
+    if (after == field) {
+        return 0;
+    }
+    while (isspace((unsigned char)*after)) {
+        after++;
+    }
+    return *after == '\0';
+}
+
+// splits line in place at delimiter, returns the number of fields
+static int splitFields(char *line, char delimiter, char **fields, int maxFields) {
+    line[strcspn(line, "\r\n")] = '\0';
+    int count = 0;
+    char *field = line;
+    while (1) {
+        char *next = strchr(field, delimiter);
+        if (count < maxFields) {
+            fields[count] = field;
+        }
+        count++;
+        if (next == NULL) {
+            break;
+        }
+        *next = '\0';
+        field = next + 1;
+    }
+    return count;
+}
+
+// the names are copied after the array of pointers, so one free releases
+// them all
+static const char *const *copyNames(char **names, int count) {
+    size_t length = 0;
+    for (int i = 0; i < count; i++) {
+        length += strlen(names[i]) + 1;
+    }
+
+    char **copy = malloc(count * sizeof(char *) + length);
+    char *text = (char *)(copy + count);
+    for (int i = 0; i < count; i++) {
+        // ARFF names can be quoted
+        char *name = names[i];
+        while (isspace((unsigned char)*name) || *name == '\'' || *name == '"') {
+            name++;
+        }
+        size_t nameLength = strlen(name);
+        while (nameLength > 0 && (isspace((unsigned char)name[nameLength - 1]) || name[nameLength - 1] == '\'' || name[nameLength - 1] == '"')) {
+            nameLength--;
+        }
+        memcpy(text, name, nameLength);
+        text[nameLength] = '\0';
+        copy[i] = text;
+        text += nameLength + 1;
+    }
+    return (const char *const *)copy;
+}
+
+// the delimiter the line has the most of, tab on ties
+static char guessDelimiter(const char *line) {
+    const char candidates[] = {'\t', ';', ','};
+    char delimiter = ',';
+    int most = 0;
+    for (int c = 0; c < 3; c++) {
+        int count = 0;
+        for (const char *p = line; *p != '\0'; p++) {
+            count += *p == candidates[c];
+        }
+        if (count > most) {
+            most = count;
+            delimiter = candidates[c];
+        }
+    }
+    return delimiter;
+}
+
+// selects the numeric fields of a data line, the last other one is the label
+static void selectColumns(DelimitedSchema *schema, char **fields, int count) {
+    int *columns = malloc((count > 0 ? count : 1) * sizeof(int));
+    int numColumns = 0;
+    for (int i = 0; i < count; i++) {
+        if (isNumber(fields[i])) {
+            columns[numColumns++] = i;
+        } else {
+            schema->labelColumn = i;
+        }
+    }
+    schema->format.columns = columns;
+    schema->format.numColumns = numColumns;
+}
+
+static int inferArff(FILE *file, DelimitedSchema *schema) {
+    char *line = NULL;
+    size_t capacity = 0;
+    int count = 0;
+    int maxCount = 16;
+    int *numeric = malloc(maxCount * sizeof(int));
+    char **names = malloc(maxCount * sizeof(char *));
+
+    while (getline(&line, &capacity, file) != -1) {
+        if (strncasecmp(line, "@data", 5) == 0) {
+            break;
+        }
+        if (strncasecmp(line, "@attribute", 10) != 0) {
+            continue;
+        }
+
+        // @attribute <name> <type>, the name can be quoted
+        char *name = line + 10;
+        while (isspace((unsigned char)*name)) {
+            name++;
+        }
+        char *nameEnd;
+        if (*name == '\'' || *name == '"') {
+            nameEnd = strchr(name + 1, *name);
+            nameEnd = nameEnd != NULL ? nameEnd + 1 : name + strlen(name);
+        } else {
+            nameEnd = name;
+            while (*nameEnd != '\0' && !isspace((unsigned char)*nameEnd)) {
+                nameEnd++;
+            }
+        }
+        char *type = nameEnd;
+        while (isspace((unsigned char)*type)) {
+            type++;
+        }
+        *nameEnd = '\0';
+
+        if (count == maxCount) {
+            maxCount *= 2;
+            numeric = realloc(numeric, maxCount * sizeof(int));
+            names = realloc(names, maxCount * sizeof(char *));
+        }
+        numeric[count] = strncasecmp(type, "numeric", 7) == 0
+            || strncasecmp(type, "real", 4) == 0
+            || strncasecmp(type, "integer", 7) == 0;
+        names[count] = strdup(name);
+        count++;
+    }
+    free(line);
+
+    int *columns = malloc((count > 0 ? count : 1) * sizeof(int));
+    int numColumns = 0;
+    for (int i = 0; i < count; i++) {
+        if (numeric[i]) {
+            columns[numColumns++] = i;
+        } else {
+            schema->labelColumn = i;
+        }
+    }
+
+    schema->format.delimiter = ',';
+    schema->format.comment = '%';
+    schema->format.endOfHeader = "@data";
+    schema->format.columns = columns;
+    schema->format.numColumns = numColumns;
+    schema->numFileColumns = count;
+    schema->columnNames = copyNames(names, count);
+    for (int i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    free(numeric);
+    return numColumns > 0;
+}
+
+// reads the next line that isn't blank or a comment, returns 0 at the end
+static int nextDataLine(FILE *file, char **line, size_t *capacity, char comment) {
+    while (getline(line, capacity, file) != -1) {
+        if ((comment == 0 || (*line)[0] != comment) && (*line)[strspn(*line, " \t\r\n")] != '\0') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// returns 0 if the file has no numeric column, the schema is freed with
+// freeDelimitedSchema
+int inferDelimitedSchema(const char *path, DelimitedSchema *schema) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror("Error while opening the file");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(schema, 0, sizeof(*schema));
+    schema->labelColumn = -1;
+
+    char *line = NULL;
+    size_t capacity = 0;
+    int lineNumber = 0;
+    int found = 0;
+    char comment = 0;
+    // the first line that isn't a comment
+    while (!found && getline(&line, &capacity, file) != -1) {
+        lineNumber++;
+        if (line[0] == '@') {
+            free(line);
+            rewind(file);
+            found = inferArff(file, schema);
+            fclose(file);
+            return found;
+        }
+        if (line[0] == '#' || line[0] == '%') {
+            comment = line[0];
+        } else {
+            found = line[strspn(line, " \t\r\n")] != '\0';
+        }
+    }
+    if (!found) {
+        free(line);
+        fclose(file);
+        return 0;
+    }
+
+    schema->format.comment = comment;
+    schema->format.delimiter = guessDelimiter(line);
+
+    char *copy = strdup(line);
+    int count = splitFields(copy, schema->format.delimiter, NULL, 0);
+    char **fields = malloc(count * sizeof(char *));
+    splitFields(line, schema->format.delimiter, fields, count);
+
+    int header = 0;
+    for (int i = 0; i < count; i++) {
+        header = header || !isNumber(fields[i]);
+    }
+
+    if (header) {
+        schema->columnNames = copyNames(fields, count);
+        schema->format.skipLines = lineNumber;
+        // the column types come from the first data line
+        if (nextDataLine(file, &line, &capacity, comment)) {
+            int dataCount = splitFields(line, schema->format.delimiter, fields, count);
+            if (dataCount < count) {
+                count = dataCount;
+            }
+        } else {
+            count = 0;
+        }
+    }
+    schema->numFileColumns = count;
+    selectColumns(schema, fields, count);
+
+    free(fields);
+    free(copy);
+    free(line);
+    fclose(file);
+    return schema->format.numColumns > 0;
+}
+
+void freeDelimitedSchema(DelimitedSchema *schema) {
+    free((void *)schema->format.columns);
+    free((void *)schema->columnNames);
+    schema->format.columns = NULL;
+    schema->columnNames = NULL;
+}
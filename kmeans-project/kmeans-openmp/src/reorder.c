@@ -0,0 +1,158 @@
+/*
+Rows grouped by cluster:
+
+In a full sweep every row is added to the sums of its cluster, which scatters
+the additions over k rows of sums in the order of the file. Every
+reorderInterval iterations lloyd sorts its private copy of the rows by their
+current cluster, so the rows of a cluster sit next to each other:
+
+   counts[t][c] = rows of cluster c in the chunk of thread t
+   start[t][c]  = rows of clusters < c + rows of cluster c in chunks < t
+   every thread copies its chunk to start[t][cluster], start[t][cluster]++
+
+The sort is stable and done with a single pass over the rows. Once the
+clusters settle, the blocks of a sweep add long runs of rows to the same sums.
+rowIds follows the rows around, so saveIterationData still reports the
+original point ids.
+
+The rows are copied from the shared dataframe through rowIds rather than
+from the sorted copy, so a sort writes the copy in place and the copy is the
+only one there is, made at the first sort. Only the ids and the assignments,
+a few bytes per row, need a spare to sort into.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../include/log.h"
+#include "../include/helper.h"
+#include "../include/reorder.h"
+
+// the spare assignments come from the arena of the assignments, since a
+// sort swaps them and either can be left in the workspace
+ClusterOrder *allocClusterOrder(Dataframe *df, int k, Assignments assignments, Arena *assignmentsArena) {
+    ClusterOrder *order = malloc(sizeof(ClusterOrder));
+    Dataframe *rows = &order->rows;
+    Arena *arena = &rows->arena;
+    const int n = df->maxRows;
+    const size_t lineInts = DATA_ALIGNMENT / sizeof(int);
+
+    *rows = *df;
+    rows->arena = (Arena){NULL};
+    order->source = df;
+    order->spareIds = arenaAlloc(arena, n * sizeof(int));
+    order->spareAssignments = arenaAlloc(assignmentsArena, (size_t)n * assignments.width);
+
+    // each thread counts into its own cache lines
+    order->numThreads = omp_get_max_threads();
+    order->countsBlock = ((size_t)k + 1 + lineInts - 1) / lineInts * lineInts;
+    order->threadCounts = arenaAlloc(arena, order->numThreads * order->countsBlock * sizeof(int));
+
+    return order;
+}
+
+// the private copy of the rows, in each precision the dataframe has, and
+// their ids in file order. Its rows are written by the first sort
+static void copyRows(ClusterOrder *order) {
+    Dataframe *rows = &order->rows;
+    Arena *arena = &rows->arena;
+    const int n = rows->maxRows;
+
+    rows->data = arenaAlloc(arena, (size_t)n * rows->stride * sizeof(double));
+    if (rows->dataF32 != NULL) {
+        rows->dataF32 = arenaAlloc(arena, (size_t)n * rows->stride * sizeof(float));
+    }
+    if (rows->dataI16 != NULL) {
+        rows->dataI16 = arenaAlloc(arena, (size_t)n * rows->strideI16 * sizeof(int16_t));
+    }
+    rows->rowIds = arenaAlloc(arena, n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        rows->rowIds[i] = i;
+    }
+}
+
+// moves every row, its id and its assignment to its place in cluster order.
+// Every row must be assigned
+void sortByCluster(ClusterOrder *order, Assignments *assignments, int k) {
+    log_debug("Sorting the rows by cluster...");
+    Dataframe *rows = &order->rows;
+    const Dataframe *source = order->source;
+    const int n = rows->maxRows;
+    const Assignments sorted = {assignments->width, order->spareAssignments};
+
+    if (rows->data == source->data) {
+        copyRows(order);
+    }
+
+    #pragma omp parallel num_threads(order->numThreads)
+    {
+        // the same static chunks in both loops, so each thread moves the rows
+        // it counted
+        int tid = omp_get_thread_num();
+        int *counts = order->threadCounts + tid * order->countsBlock;
+        memset(counts, 0, (k + 1) * sizeof(int));
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < n; i++) {
+            counts[getAssignment(*assignments, i)]++;
+        }
+
+        #pragma omp single
+        {
+            int team = omp_get_num_threads();
+            int start = 0;
+            for (int c = 0; c < k; c++) {
+                for (int t = 0; t < team; t++) {
+                    int *count = order->threadCounts + t * order->countsBlock + c;
+                    int rowsOfThread = *count;
+                    *count = start;
+                    start += rowsOfThread;
+                }
+            }
+        }
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < n; i++) {
+            int cluster = getAssignment(*assignments, i);
+            int target = counts[cluster]++;
+            int id = rows->rowIds[i];
+
+            memcpy(
+                rows->data + (size_t)target * rows->stride,
+                dfRow(source, id),
+                rows->stride * sizeof(double)
+            );
+            if (rows->dataF32 != NULL) {
+                memcpy(
+                    rows->dataF32 + (size_t)target * rows->stride,
+                    dfRowF32(source, id),
+                    rows->stride * sizeof(float)
+                );
+            }
+            if (rows->dataI16 != NULL) {
+                memcpy(
+                    rows->dataI16 + (size_t)target * rows->strideI16,
+                    dfRowI16(source, id),
+                    rows->strideI16 * sizeof(int16_t)
+                );
+            }
+            order->spareIds[target] = id;
+            setAssignment(sorted, target, cluster);
+        }
+    }
+
+    int *rowIds = rows->rowIds;
+    rows->rowIds = order->spareIds;
+    order->spareIds = rowIds;
+
+    void *assigned = assignments->data;
+    assignments->data = order->spareAssignments;
+    order->spareAssignments = assigned;
+}
+
+// the spare assignments go with the workspace
+void freeClusterOrder(ClusterOrder *order) {
+    releaseArena(&order->rows.arena);
+    free(order);
+}
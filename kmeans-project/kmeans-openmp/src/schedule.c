@@ -0,0 +1,119 @@
+/*
+Scheduler of the experiments of a run.
+
+Every experiment parallelizes its sweeps over the rows, which pays off on
+WESAD but not on Iris, where a fork/join costs more than an iteration over
+150 rows. The experiments themselves are independent, so there are three ways
+to spread the threads:
+
+   data          experiments one after the other, all the threads split the
+                 rows of every sweep
+   experiments   one thread per experiment, each experiment runs serially
+   nested        numExp teams of threads / numExp threads, each team splits
+                 the rows of its experiment
+
+auto picks one from the work of an iteration, maxRows * k * numFeatures:
+large iterations use data, small ones use experiments, or nested when there
+are fewer experiments than threads so no thread is left idle.
+*/
+
+#include <string.h>
+#include <omp.h>
+
+#include "../include/log.h"
+#include "../include/helper.h"
+#include "../include/distance.h"
+#include "../include/kmeans.h"
+#include "../include/schedule.h"
+
+const char *scheduleName(Schedule schedule) {
+    switch (schedule) {
+        case SCHEDULE_DATA:
+            return "data";
+        case SCHEDULE_EXPERIMENTS:
+            return "experiments";
+        case SCHEDULE_NESTED:
+            return "nested";
+        case SCHEDULE_AUTO:
+        default:
+            return "auto";
+    }
+}
+
+int parseSchedule(const char *name, Schedule *schedule) {
+    if (strcmp(name, "auto") == 0) {
+        *schedule = SCHEDULE_AUTO;
+    } else if (strcmp(name, "data") == 0) {
+        *schedule = SCHEDULE_DATA;
+    } else if (strcmp(name, "experiments") == 0) {
+        *schedule = SCHEDULE_EXPERIMENTS;
+    } else if (strcmp(name, "nested") == 0) {
+        *schedule = SCHEDULE_NESTED;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// replaces auto with the schedule that fits the run
+Schedule pickSchedule(Dataframe *df, int numExp, int k, Schedule schedule) {
+    if (schedule != SCHEDULE_AUTO) {
+        return schedule;
+    }
+
+    // a streamed dataframe is read by one experiment at a time
+    int numThreads = omp_get_max_threads();
+    if (numThreads == 1 || numExp == 1 || df->streamed) {
+        return SCHEDULE_DATA;
+    }
+
+    double work = (double)df->maxRows * k * df->numFeatures;
+    if (work >= SCHEDULE_SMALL_WORK) {
+        return SCHEDULE_DATA;
+    }
+    return numExp >= numThreads ? SCHEDULE_EXPERIMENTS : SCHEDULE_NESTED;
+}
+
+void runExperiments(
+    Dataframe *df,
+    Experiment *experiments,
+    int numExp,
+    int k,
+    int maxIter,
+    int debug,
+    const KmeansConfig *config
+) {
+    Schedule schedule = pickSchedule(df, numExp, k, config->schedule);
+    int numThreads = omp_get_max_threads();
+    log_debug("Running %d experiments with the %s schedule...", numExp, scheduleName(schedule));
+
+    if (schedule == SCHEDULE_DATA) {
+        for (int i = 0; i < numExp; i++) {
+            log_debug("Running experiment %d...\n", i);
+            kmeans(df, &experiments[i], k, maxIter, i, debug, config);
+            experiments[i].schedule = schedule;
+        }
+        return;
+    }
+
+    // every outer thread runs whole experiments, the inner parallel regions
+    // of kmeans() get a team of innerThreads, a single thread unless nested
+    int outerThreads = numExp < numThreads ? numExp : numThreads;
+    int innerThreads = 1;
+    int maxActiveLevels = omp_get_max_active_levels();
+    if (schedule == SCHEDULE_NESTED) {
+        innerThreads = numThreads / outerThreads > 1 ? numThreads / outerThreads : 1;
+        omp_set_max_active_levels(2);
+    }
+
+    // experiments can converge at very different iterations, hence dynamic
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(outerThreads)
+    for (int i = 0; i < numExp; i++) {
+        omp_set_num_threads(innerThreads);
+        log_debug("Running experiment %d on thread %d...\n", i, omp_get_thread_num());
+        kmeans(df, &experiments[i], k, maxIter, i, debug, config);
+        experiments[i].schedule = schedule;
+    }
+
+    omp_set_max_active_levels(maxActiveLevels);
+}
@@ -0,0 +1,317 @@
+/*
+Centroid seeding:
+
+random:   k rows drawn uniformly, the original initialization.
+
+kmeans++: (Arthur and Vassilvitskii, 2007) the first centroid is a uniform
+          row, every next one is drawn with probability proportional to
+          D(x)^2, the squared distance to the closest centroid chosen so far.
+          It takes k passes over the data, each one parallel.
+
+kmeans||: (Bahmani et al., 2012) starts from one uniform row and, for a few
+          rounds, keeps every row independently with probability
+          l * D(x)^2 / phi (l = 2k oversampling, phi = sum of D(x)^2). The
+          candidates are weighted by how many rows they're closest to and
+          reduced to k with a weighted, greedy kmeans++. It needs a handful of
+          passes regardless of k.
+
+The random draws of a row only depend on the seed, the pass and the row index,
+and the weights are summed over a fixed number of chunks, so the draws round
+the same way and the result doesn't depend on the number of threads.
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+#include <string.h>
+
+#include "../include/log.h"
+#include "../include/helper.h"
+#include "../include/seeding.h"
+
+#define KMEANS_PARALLEL_ROUNDS 5
+#define KMEANS_PARALLEL_OVERSAMPLING 2
+// the weights are summed per chunk, whatever the number of threads
+#define SEEDING_CHUNKS 256
+
+// counter-based draw, the same (seed, counter) always gives the same number
+static double drawUniform(uint64_t seed, uint64_t counter) {
+    uint64_t state = seed ^ (counter * 0xD1B54A32D192ED03ULL);
+    return nextUniform(&state);
+}
+
+static void copyRow(Dataframe *df, double *centroids, int centroid, const double *row) {
+    memcpy(centroids + centroid * df->stride, row, df->stride * sizeof(double));
+}
+
+void seedRandom(Dataframe *df, double *centroids, int k, uint64_t seed) {
+    uint64_t rng = seed;
+
+    for (int i = 0; i < k; i++)
+    {
+        int random_index = (int)(nextRandom(&rng) % df->maxRows);
+        copyRow(df, centroids, i, dfRow(df, random_index));
+    }
+}
+
+// sums the weights of every chunk and returns their total, added in chunk
+// order so it rounds the same way on any number of threads
+static double sumChunks(const double *weights, int n, double *chunkSums) {
+    int chunkSize = (n + SEEDING_CHUNKS - 1) / SEEDING_CHUNKS;
+
+    #pragma omp parallel for schedule(static) if(n > 16 * SEEDING_CHUNKS)
+    for (int c = 0; c < SEEDING_CHUNKS; c++) {
+        int begin = c * chunkSize < n ? c * chunkSize : n;
+        int end = (c + 1) * chunkSize < n ? (c + 1) * chunkSize : n;
+        double sum = 0.0;
+        for (int i = begin; i < end; i++) {
+            sum += weights[i];
+        }
+        chunkSums[c] = sum;
+    }
+
+    double total = 0.0;
+    for (int c = 0; c < SEEDING_CHUNKS; c++) {
+        total += chunkSums[c];
+    }
+    return total;
+}
+
+// draws an index with probability weights[i] / total, the weights are summed
+// per chunk first so only one chunk has to be scanned serially
+static int weightedDraw(const double *weights, int n, double uniform) {
+    int chunkSize = (n + SEEDING_CHUNKS - 1) / SEEDING_CHUNKS;
+    double chunkSums[SEEDING_CHUNKS];
+    double target = uniform * sumChunks(weights, n, chunkSums);
+
+    int chosen = n - 1;
+    for (int c = 0; c < SEEDING_CHUNKS; c++) {
+        if (target < chunkSums[c]) {
+            int end = (c + 1) * chunkSize < n ? (c + 1) * chunkSize : n;
+            for (int i = c * chunkSize; i < end; i++) {
+                target -= weights[i];
+                if (target < 0.0) {
+                    chosen = i;
+                    break;
+                }
+            }
+            break;
+        }
+        target -= chunkSums[c];
+    }
+
+    // rounding may walk past the last positive weight
+    while (chosen > 0 && weights[chosen] == 0.0) {
+        chosen--;
+    }
+
+    return chosen;
+}
+
+void seedKmeansPlusPlus(Dataframe *df, double *centroids, int k, uint64_t seed) {
+    int n = df->maxRows;
+    double *minDistance = malloc(n * sizeof(double));
+    uint64_t rng = seed;
+
+    copyRow(df, centroids, 0, dfRow(df, (int)(nextRandom(&rng) % n)));
+
+    for (int c = 1; c <= k; c++) {
+        const double *newest = centroids + (c - 1) * df->stride;
+        // only tells whether any row is left to draw, weightedDraw sums the
+        // weights itself
+        double total = 0.0;
+
+        #pragma omp parallel for schedule(static) reduction(+:total)
+        for (int i = 0; i < n; i++) {
+            double distance = squaredEuclideanDistance(dfRow(df, i), newest, df->numFeatures);
+            if (c == 1 || distance < minDistance[i]) {
+                minDistance[i] = distance;
+            }
+            total += minDistance[i];
+        }
+
+        if (c == k) {
+            break;
+        }
+
+        // every row already is a centroid, any row will do
+        int chosen = total > 0.0
+            ? weightedDraw(minDistance, n, nextUniform(&rng))
+            : (int)(nextRandom(&rng) % n);
+        copyRow(df, centroids, c, dfRow(df, chosen));
+    }
+
+    free(minDistance);
+}
+
+// serial weighted kmeans++ over the kmeans|| candidates. The candidates are
+// few, so every step tries a few draws and keeps the one that lowers the
+// weighted potential the most (greedy kmeans++)
+static void reduceCandidates(
+    Dataframe *df,
+    double *candidates,
+    double *weights,
+    int numCandidates,
+    double *centroids,
+    int k,
+    uint64_t *rng
+) {
+    int trials = 2 + (int)log(k);
+    double *minDistance = malloc(numCandidates * sizeof(double));
+    double *trialDistance = malloc(numCandidates * sizeof(double));
+    double *scores = malloc(numCandidates * sizeof(double));
+
+    for (int i = 0; i < numCandidates; i++) {
+        minDistance[i] = INFINITY;
+        scores[i] = weights[i];
+    }
+    double total = numCandidates > 0 ? (double)df->maxRows : 0.0;
+
+    for (int c = 0; c < k; c++) {
+        double bestPotential = INFINITY;
+        int best = 0;
+
+        for (int trial = 0; trial < (c == 0 ? 1 : trials); trial++) {
+            int chosen = total > 0.0
+                ? weightedDraw(scores, numCandidates, nextUniform(rng))
+                : (int)(nextRandom(rng) % numCandidates);
+            const double *candidate = candidates + (size_t)chosen * df->stride;
+
+            double potential = 0.0;
+            for (int i = 0; i < numCandidates; i++) {
+                double distance = squaredEuclideanDistance(
+                    candidates + (size_t)i * df->stride, candidate, df->numFeatures
+                );
+                trialDistance[i] = fmin(minDistance[i], distance);
+                potential += weights[i] * trialDistance[i];
+            }
+
+            if (potential < bestPotential) {
+                bestPotential = potential;
+                best = chosen;
+            }
+        }
+
+        copyRow(df, centroids, c, candidates + (size_t)best * df->stride);
+
+        total = 0.0;
+        for (int i = 0; i < numCandidates; i++) {
+            double distance = squaredEuclideanDistance(
+                candidates + (size_t)i * df->stride, candidates + (size_t)best * df->stride,
+                df->numFeatures
+            );
+            minDistance[i] = fmin(minDistance[i], distance);
+            scores[i] = weights[i] * minDistance[i];
+            total += scores[i];
+        }
+    }
+
+    free(minDistance);
+    free(trialDistance);
+    free(scores);
+}
+
+void seedKmeansParallel(Dataframe *df, double *centroids, int k, uint64_t seed) {
+    int n = df->maxRows;
+    double oversampling = (double)KMEANS_PARALLEL_OVERSAMPLING * k;
+    int capacity = 1 + (int)(oversampling * KMEANS_PARALLEL_ROUNDS * 2) + k;
+
+    double *candidates = allocMatrix(capacity, df->stride);
+    double *minDistance = malloc(n * sizeof(double));
+    int *nearest = malloc(n * sizeof(int));
+    char *selected = malloc(n);
+    int numCandidates = 0;
+    uint64_t rng = seed;
+
+    copyRow(df, candidates, numCandidates++, dfRow(df, (int)(nextRandom(&rng) % n)));
+
+    for (int i = 0; i < n; i++) {
+        minDistance[i] = INFINITY;
+    }
+
+    double chunkSums[SEEDING_CHUNKS];
+    int checked = 0; // candidates already folded into minDistance
+    for (int round = 0; round <= KMEANS_PARALLEL_ROUNDS; round++) {
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++) {
+            const double *row = dfRow(df, i);
+            for (int c = checked; c < numCandidates; c++) {
+                double distance = squaredEuclideanDistance(
+                    row, candidates + (size_t)c * df->stride, df->numFeatures
+                );
+                if (distance < minDistance[i]) {
+                    minDistance[i] = distance;
+                    nearest[i] = c;
+                }
+            }
+        }
+        double phi = sumChunks(minDistance, n, chunkSums);
+        checked = numCandidates;
+
+        // the last pass only updates the distances of the last round
+        if (round == KMEANS_PARALLEL_ROUNDS || phi == 0.0) {
+            break;
+        }
+
+        uint64_t roundSeed = nextRandom(&rng);
+
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++) {
+            double probability = oversampling * minDistance[i] / phi;
+            selected[i] = drawUniform(roundSeed, i) < probability;
+        }
+
+        // compacting serially keeps the candidates in row order. The expected
+        // count is l per round, a draw above the capacity grows the buffer so
+        // no candidate is dropped
+        for (int i = 0; i < n; i++) {
+            if (!selected[i]) {
+                continue;
+            }
+            if (numCandidates == capacity) {
+                double *grown = allocMatrix(2 * capacity, df->stride);
+                memcpy(grown, candidates, (size_t)capacity * df->stride * sizeof(double));
+                free(candidates);
+                candidates = grown;
+                capacity *= 2;
+            }
+            copyRow(df, candidates, numCandidates++, dfRow(df, i));
+        }
+    }
+
+    log_debug("k-means|| sampled %d candidates", numCandidates);
+
+    double *weights = calloc(numCandidates, sizeof(double));
+    #pragma omp parallel
+    {
+        double *localWeights = calloc(numCandidates, sizeof(double));
+
+        #pragma omp for schedule(static)
+        for (int i = 0; i < n; i++) {
+            localWeights[nearest[i]] += 1.0;
+        }
+
+        #pragma omp critical
+        for (int c = 0; c < numCandidates; c++) {
+            weights[c] += localWeights[c];
+        }
+
+        free(localWeights);
+    }
+
+    if (numCandidates <= k) {
+        // tiny datasets: keep every candidate and fill up with random rows
+        memcpy(centroids, candidates, (size_t)numCandidates * df->stride * sizeof(double));
+        for (int c = numCandidates; c < k; c++) {
+            copyRow(df, centroids, c, dfRow(df, (int)(nextRandom(&rng) % n)));
+        }
+    } else {
+        reduceCandidates(df, candidates, weights, numCandidates, centroids, k, &rng);
+    }
+
+    free(candidates);
+    free(minDistance);
+    free(nearest);
+    free(selected);
+    free(weights);
+}
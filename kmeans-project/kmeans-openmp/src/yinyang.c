@@ -0,0 +1,315 @@
+/*
+Yinyang K-Means (Ding et al., 2015):
+
+The k centroids are split once into t = k / 10 groups and every point keeps
+   - an upper bound u(x) >= d(x, c_a(x))
+   - one lower bound l(x, g) per group, below the distance to every centroid
+     of group g other than c_a(x)
+
+After the update step u(x) grows by the drift of its own centroid and l(x, g)
+shrinks by the largest drift inside g. On the next assignment step:
+   - global filter: the point is skipped when u(x) <= min_g l(x, g)
+   - group filter: only the groups with l(x, g) < u(x) are visited
+   - local filter: inside a visited group, c_j is skipped when the old group
+     bound minus the drift of c_j is already >= u(x)
+
+Every skipped distance is provably larger than the one to the assigned
+centroid, so the clusters are the same as Lloyd's. With large k most groups
+are filtered and the distance evaluations drop by an order of magnitude.
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+#include <string.h>
+
+#include "../include/log.h"
+#include "../include/helper.h"
+#include "../include/experiments.h"
+#include "../include/distance.h"
+#include "../include/kmeans.h"
+#include "../include/yinyang.h"
+
+#define YINYANG_GROUP_SIZE 10
+#define YINYANG_GROUP_ITERATIONS 5
+
+// groups the initial centroids with a few Lloyd iterations over the centroids
+// themselves, the members of group g are members[groupStart[g]..groupStart[g + 1]]
+static void groupCentroids(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    int t,
+    int *groupOf,
+    int *groupStart,
+    int *members
+) {
+    double *groupCenters = allocMatrix(t, df->stride);
+    double *sums = malloc((size_t)t * df->stride * sizeof(double));
+    int *counts = malloc(t * sizeof(int));
+
+    // spread the starting centers over the centroid list
+    for (int g = 0; g < t; g++) {
+        memcpy(
+            groupCenters + g * df->stride,
+            centroids + (size_t)g * k / t * df->stride,
+            df->stride * sizeof(double)
+        );
+    }
+
+    for (int iteration = 0; iteration < YINYANG_GROUP_ITERATIONS; iteration++) {
+        for (int j = 0; j < k; j++) {
+            double minDistance = INFINITY;
+            for (int g = 0; g < t; g++) {
+                double distance = euclideanDistance(
+                    centroids + j * df->stride, groupCenters + g * df->stride, df->numFeatures
+                );
+                if (distance < minDistance) {
+                    minDistance = distance;
+                    groupOf[j] = g;
+                }
+            }
+        }
+
+        memset(sums, 0, (size_t)t * df->stride * sizeof(double));
+        memset(counts, 0, t * sizeof(int));
+        for (int j = 0; j < k; j++) {
+            counts[groupOf[j]]++;
+            for (int l = 0; l < df->numFeatures; l++) {
+                sums[groupOf[j] * df->stride + l] += centroids[j * df->stride + l];
+            }
+        }
+        for (int g = 0; g < t; g++) {
+            if (counts[g] > 0) {
+                for (int l = 0; l < df->numFeatures; l++) {
+                    groupCenters[g * df->stride + l] = sums[g * df->stride + l] / counts[g];
+                }
+            }
+        }
+    }
+
+    groupStart[0] = 0;
+    for (int g = 0; g < t; g++) {
+        groupStart[g + 1] = groupStart[g] + counts[g];
+    }
+    for (int g = 0, m = 0; g < t; g++) {
+        for (int j = 0; j < k; j++) {
+            if (groupOf[j] == g) {
+                members[m++] = j;
+            }
+        }
+    }
+
+    free(groupCenters);
+    free(sums);
+    free(counts);
+}
+
+void yinyang(
+    Dataframe *df,
+    double *centroids,
+    int k,
+    int maxIter,
+    Experiment *exp,
+    int debug,
+    Workspace *ws
+) {
+    int n = df->maxRows;
+    int t = k / YINYANG_GROUP_SIZE > 0 ? k / YINYANG_GROUP_SIZE : 1;
+
+    int *groupOf = arenaAlloc(&ws->arena, k * sizeof(int));
+    int *groupStart = arenaAlloc(&ws->arena, (t + 1) * sizeof(int));
+    int *members = arenaAlloc(&ws->arena, k * sizeof(int));
+    groupCentroids(df, centroids, k, t, groupOf, groupStart, members);
+    log_debug("Grouped %d centroids into %d groups", k, t);
+
+    Assignments assignments = ws->assignments;
+    double *upper = arenaAlloc(&ws->arena, n * sizeof(double));
+    double *lower = arenaAlloc(&ws->arena, (size_t)n * t * sizeof(double));
+    double *drift = arenaAlloc(&ws->arena, k * sizeof(double));
+    double *groupDrift = arenaAlloc(&ws->arena, t * sizeof(double));
+    double *prevCentroids = ws->prevCentroids;
+
+    // per thread group candidates of the current row, padded to whole cache
+    // lines of both doubles and ints
+    const size_t lineInts = DATA_ALIGNMENT / sizeof(int);
+    size_t groupBlock = ((size_t)t + lineInts - 1) / lineInts * lineInts;
+    double *threadGroupFirst = arenaAlloc(&ws->arena, ws->numThreads * groupBlock * sizeof(double));
+    double *threadGroupSecond = arenaAlloc(&ws->arena, ws->numThreads * groupBlock * sizeof(double));
+    int *threadGroupFirstIdx = arenaAlloc(&ws->arena, ws->numThreads * groupBlock * sizeof(int));
+
+    long long distances = 0;
+
+    log_debug("Initializing Yinyang bounds...");
+    #pragma omp parallel for schedule(static) reduction(+:distances)
+    for (int i = 0; i < n; i++) {
+        const double *row = dfRow(df, i);
+        double *l = lower + (size_t)i * t;
+        double minDistance = INFINITY;
+        int closestCentroid = 0;
+
+        for (int g = 0; g < t; g++) {
+            l[g] = INFINITY;
+        }
+
+        for (int j = 0; j < k; j++) {
+            double distance = euclideanDistance(row, centroids + j * df->stride, df->numFeatures);
+            if (distance < minDistance) {
+                // the previous closest centroid now counts for its group bound
+                if (minDistance < l[groupOf[closestCentroid]]) {
+                    l[groupOf[closestCentroid]] = minDistance;
+                }
+                minDistance = distance;
+                closestCentroid = j;
+            } else if (distance < l[groupOf[j]]) {
+                l[groupOf[j]] = distance;
+            }
+        }
+
+        setAssignment(assignments, i, closestCentroid);
+        upper[i] = minDistance;
+        distances += k;
+    }
+
+    int iteration = 0;
+
+    while (maxIter > 0)
+    {
+        if (iteration > 0) {
+            log_debug("Updating assignments with Yinyang bounds...");
+
+            #pragma omp parallel reduction(+:distances)
+            {
+                // per group closest and second closest candidates of the current row
+                int tid = omp_get_thread_num();
+                double *groupFirst = threadGroupFirst + tid * groupBlock;
+                double *groupSecond = threadGroupSecond + tid * groupBlock;
+                int *groupFirstIdx = threadGroupFirstIdx + tid * groupBlock;
+
+                #pragma omp for schedule(dynamic, 1024)
+                for (int i = 0; i < n; i++) {
+                    double *l = lower + (size_t)i * t;
+                    int a = getAssignment(assignments, i);
+
+                    double globalLower = INFINITY;
+                    for (int g = 0; g < t; g++) {
+                        globalLower = fmin(globalLower, l[g]);
+                    }
+
+                    if (upper[i] <= globalLower) {
+                        continue;
+                    }
+
+                    const double *row = dfRow(df, i);
+                    double u = euclideanDistance(row, centroids + a * df->stride, df->numFeatures);
+                    distances++;
+
+                    if (u <= globalLower) {
+                        upper[i] = u;
+                        continue;
+                    }
+
+                    for (int g = 0; g < t; g++) {
+                        groupFirstIdx[g] = -1;
+                        if (l[g] >= u) {
+                            continue;
+                        }
+
+                        double oldLower = l[g] + groupDrift[g];
+                        double first = INFINITY;
+                        double second = INFINITY;
+                        int firstIdx = -2; // visited, no candidate yet
+
+                        for (int m = groupStart[g]; m < groupStart[g + 1]; m++) {
+                            int j = members[m];
+                            if (j == a) {
+                                continue;
+                            }
+
+                            // a skipped centroid still bounds the group from below
+                            double value = oldLower - drift[j];
+                            if (value < u) {
+                                value = euclideanDistance(
+                                    row, centroids + j * df->stride, df->numFeatures
+                                );
+                                distances++;
+                            }
+
+                            if (value < first) {
+                                second = first;
+                                first = value;
+                                firstIdx = j;
+                            } else if (value < second) {
+                                second = value;
+                            }
+                        }
+
+                        groupFirst[g] = first;
+                        groupSecond[g] = second;
+                        groupFirstIdx[g] = firstIdx;
+                    }
+
+                    int best = a;
+                    double bestDistance = u;
+                    for (int g = 0; g < t; g++) {
+                        if (groupFirstIdx[g] >= 0 && groupFirst[g] < bestDistance) {
+                            best = groupFirstIdx[g];
+                            bestDistance = groupFirst[g];
+                        }
+                    }
+
+                    for (int g = 0; g < t; g++) {
+                        if (groupFirstIdx[g] != -1) {
+                            l[g] = groupFirstIdx[g] == best ? groupSecond[g] : groupFirst[g];
+                        }
+                    }
+
+                    // the old centroid becomes one of the others of its group
+                    if (best != a && u < l[groupOf[a]]) {
+                        l[groupOf[a]] = u;
+                    }
+
+                    setAssignment(assignments, i, best);
+                    upper[i] = bestDistance;
+                }
+            }
+        }
+
+        if(debug) {
+            saveIterationData(centroids, assignments, df, k, iteration, exp->number);
+        }
+
+        memcpy(prevCentroids, centroids, (size_t)k * df->stride * sizeof(double));
+        exp->changedPoints += updateCentroids(df, centroids, assignments, k, ws);
+
+        if (hasConverged(
+            centroids, prevCentroids, k, df->numFeatures, df->stride, CONVERGENCE_THRESHOLD
+        )) {
+            log_debug("Convergence achieved after %d iterations.", iteration + 1);
+            break;
+        }
+
+        centroidDrift(df, centroids, prevCentroids, k, drift);
+        for (int g = 0; g < t; g++) {
+            groupDrift[g] = 0.0;
+        }
+        for (int j = 0; j < k; j++) {
+            groupDrift[groupOf[j]] = fmax(groupDrift[groupOf[j]], drift[j]);
+        }
+
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < n; i++) {
+            double *l = lower + (size_t)i * t;
+            upper[i] += drift[getAssignment(assignments, i)];
+            for (int g = 0; g < t; g++) {
+                l[g] -= groupDrift[g];
+            }
+        }
+
+        log_debug("Max iterations left: %d", --maxIter);
+        iteration++;
+    }
+
+    exp->convergenceIteration = iteration;
+    exp->distanceCount += distances;
+}
@@ -2,7 +2,7 @@
 #define EXPERIMENTS_H
 
 void saveIterationData(
-    double **centroids,
+    double *centroids,
     int *assignments,
     Dataframe *df,
     int k,
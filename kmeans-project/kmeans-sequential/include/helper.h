@@ -1,15 +1,22 @@
 #ifndef HELPER_H
 #define HELPER_H
 
+#include <stddef.h>
+
+// every row buffer is aligned to a cache line
+#define DATA_ALIGNMENT 64
+
 typedef struct {
     char *name;
-    double **data;
+    // rows are stored contiguously (row-major), row i starts at data + i * stride
+    double *data;
     char **features; // list of features
     int maxRows;
     int maxColumns;
     int numFeatures;
     int startColumn;
     int endColumn;
+    int stride; // doubles per row, >= numFeatures, the padding is zeroed
 } Dataframe;
 
 typedef struct {
@@ -18,6 +25,14 @@ typedef struct {
     int convergenceIteration;
 } Experiment;
 
-double euclideanDistance(double *point1, double *point2, int numFeatures);
+static inline double *dfRow(const Dataframe *df, int i) {
+    return df->data + (size_t)i * df->stride;
+}
+
+int rowStride(int numFeatures);
+double *allocMatrix(int rows, int stride);
+void freeDataframe(Dataframe *df);
+
+double euclideanDistance(const double *point1, const double *point2, int numFeatures);
 
 #endif
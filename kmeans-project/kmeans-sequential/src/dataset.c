@@ -27,7 +27,8 @@ Dataframe loadIris(const char *filename)
     }
 
     char **features = malloc(NUM_FEATURES * sizeof(char *));
-    double **matrix = malloc(MAX_ROWS * sizeof(double *));
+    int stride = rowStride(NUM_FEATURES);
+    double *matrix = allocMatrix(MAX_ROWS, stride);
 
     features[0] = "SepalLengthCm";
     features[1] = "SepalWidthCm";
@@ -45,12 +46,12 @@ Dataframe loadIris(const char *filename)
             file, "%d,%lf,%lf,%lf,%lf,%49[^\n]\n", &id, &f1, &f2, &f3, &f4, label
         );
 
-        matrix[row] = malloc((NUM_FEATURES) * sizeof(double));
+        double *values = matrix + (size_t)row * stride;
 
-        matrix[row][0] = f1;
-        matrix[row][1] = f2;
-        matrix[row][2] = f3;
-        matrix[row][3] = f4;
+        values[0] = f1;
+        values[1] = f2;
+        values[2] = f3;
+        values[3] = f4;
         row++;
     }
 
@@ -65,7 +66,8 @@ Dataframe loadIris(const char *filename)
         MAX_COLUMNS,
         NUM_FEATURES,
         1,
-        NUM_FEATURES
+        NUM_FEATURES,
+        stride
     };
     return df;
 }
@@ -93,7 +95,8 @@ Dataframe loadRice(const char *filename)
         }
     }
 
-    double **matrix = malloc(MAX_ROWS * sizeof(double *));
+    int stride = rowStride(NUM_FEATURES);
+    double *matrix = allocMatrix(MAX_ROWS, stride);
     char **features = malloc(NUM_FEATURES * sizeof(char *));
 
     features[0] = "PerimeterReal";
@@ -115,14 +118,14 @@ Dataframe loadRice(const char *filename)
             &f1, &f2, &f3, &f4, &f5, &f6, label
         );
 
-        matrix[row] = malloc((NUM_FEATURES) * sizeof(double));
+        double *values = matrix + (size_t)row * stride;
 
-        matrix[row][0] = f1;
-        matrix[row][1] = f2;
-        matrix[row][2] = f3;
-        matrix[row][3] = f4;
-        matrix[row][4] = f5;
-        matrix[row][5] = f6;
+        values[0] = f1;
+        values[1] = f2;
+        values[2] = f3;
+        values[3] = f4;
+        values[4] = f5;
+        values[5] = f6;
         row++;
     }
 
@@ -138,7 +141,8 @@ Dataframe loadRice(const char *filename)
         MAX_COLUMNS,
         NUM_FEATURES,
         0,
-        NUM_FEATURES
+        NUM_FEATURES,
+        stride
     };
     return df;
 }
@@ -155,7 +159,8 @@ Dataframe loadHtru2(const char *filename) {
         exit(EXIT_FAILURE);
     }
 
-    double **matrix = malloc(MAX_ROWS * sizeof(double *));
+    int stride = rowStride(NUM_FEATURES);
+    double *matrix = allocMatrix(MAX_ROWS, stride);
     char **features = malloc(NUM_FEATURES * sizeof(char *));
 
     features[0] = "profileMean";
@@ -179,16 +184,16 @@ Dataframe loadHtru2(const char *filename) {
             &f1, &f2, &f3, &f4, &f5, &f6, &f7, &f8, label
         );
 
-        matrix[row] = malloc((NUM_FEATURES) * sizeof(double));
+        double *values = matrix + (size_t)row * stride;
 
-        matrix[row][0] = f1;
-        matrix[row][1] = f2;
-        matrix[row][2] = f3;
-        matrix[row][3] = f4;
-        matrix[row][4] = f5;
-        matrix[row][5] = f6;
-        matrix[row][6] = f7;
-        matrix[row][7] = f8;
+        values[0] = f1;
+        values[1] = f2;
+        values[2] = f3;
+        values[3] = f4;
+        values[4] = f5;
+        values[5] = f6;
+        values[6] = f7;
+        values[7] = f8;
         row++;
     }
 
@@ -204,7 +209,8 @@ Dataframe loadHtru2(const char *filename) {
         MAX_COLUMNS,
         NUM_FEATURES,
         0,
-        NUM_FEATURES-1
+        NUM_FEATURES-1,
+        stride
     };
     return df;
 }
@@ -229,7 +235,8 @@ Dataframe loadWset(const char *filename)
         }
     }
 
-    double **matrix = malloc(MAX_ROWS * sizeof(double *));
+    int stride = rowStride(NUM_FEATURES);
+    double *matrix = allocMatrix(MAX_ROWS, stride);
     char **features = malloc(NUM_FEATURES * sizeof(char *));
 
     features[0] = "ECG";
@@ -257,9 +264,9 @@ Dataframe loadWset(const char *filename)
             continue;
         }
 
-        matrix[row] = malloc(NUM_FEATURES * sizeof(double));
+        double *values = matrix + (size_t)row * stride;
         for (int i = 0; i < NUM_FEATURES; i++) {
-            matrix[row][i] = (double)ch[i];
+            values[i] = (double)ch[i];
         }
         row++;
     }
@@ -276,7 +283,8 @@ Dataframe loadWset(const char *filename)
         MAX_COLUMNS,
         NUM_FEATURES,
         2,
-        NUM_FEATURES
+        NUM_FEATURES,
+        stride
     };
     return df;
 }
@@ -7,7 +7,7 @@
 #include "../include/log.h"
 
 void saveIterationData(
-    double **centroids,
+    double *centroids,
     int *assignments,
     Dataframe *df,
     int k,
@@ -52,10 +52,11 @@ void saveIterationData(
     fprintf(file, "point_id,dataset,%s,cluster\n", features);
 
     for (int i = 0; i < df->maxRows; i++) {
+        const double *row = dfRow(df, i);
         fprintf(file, "%d", i);
         fprintf(file, ",%s", df->name);
         for (int j = 0; j < df->numFeatures; j++) {
-            fprintf(file, ",%f", df->data[i][j]);
+            fprintf(file, ",%f", row[j]);
         }
         fprintf(file, ",%d\n", assignments[i]);
     }
@@ -64,7 +65,7 @@ void saveIterationData(
         fprintf(file, "c%d", i);
         fprintf(file, ",%s", df->name);
         for (int j = 0; j < df->numFeatures; j++) {
-            fprintf(file, ",%f", centroids[i][j]);
+            fprintf(file, ",%f", centroids[i * df->stride + j]);
         }
         fprintf(file, ",%d\n", i);
     }
@@ -1,8 +1,11 @@
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <ctype.h>
 
+#include "../include/helper.h"
 
-double euclideanDistance(double *point1, double *point2, int numFeatures)
+double euclideanDistance(const double *point1, const double *point2, int numFeatures)
 {
     double sum = 0.0;
     for (int i = 0; i < numFeatures; i++)
@@ -12,3 +15,41 @@ double euclideanDistance(double *point1, double *point2, int numFeatures)
     }
     return sqrt(sum);
 }
+
+int rowStride(int numFeatures) {
+    // pad short rows to a power of two so a row never straddles a cache line,
+    // wider rows are padded to a whole number of cache lines
+    const int lineDoubles = DATA_ALIGNMENT / sizeof(double);
+
+    if (numFeatures > lineDoubles) {
+        return (numFeatures + lineDoubles - 1) / lineDoubles * lineDoubles;
+    }
+
+    int stride = 1;
+    while (stride < numFeatures) {
+        stride *= 2;
+    }
+    return stride;
+}
+
+double *allocMatrix(int rows, int stride) {
+    size_t size = (size_t)rows * stride * sizeof(double);
+    // aligned_alloc wants the size to be a multiple of the alignment
+    size = (size + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+    if (size == 0) {
+        size = DATA_ALIGNMENT;
+    }
+
+    double *matrix = aligned_alloc(DATA_ALIGNMENT, size);
+    if (matrix != NULL) {
+        memset(matrix, 0, size);
+    }
+    return matrix;
+}
+
+void freeDataframe(Dataframe *df) {
+    free(df->data);
+    free(df->features);
+    df->data = NULL;
+    df->features = NULL;
+}
@@ -25,26 +25,28 @@ End Algorithm
 #include <stdlib.h>
 #include <time.h>
 #include <math.h>
+#include <string.h>
 #include <omp.h>
 
 #include "../include/log.h"
 #include "../include/helper.h"
 #include "../include/experiments.h"
 
-double **initCentroids(Dataframe *df, int k, int expNumber) {
+double *initCentroids(Dataframe *df, int k, int expNumber) {
     // Initialize centroids by randomly selecting k data points from the dataset
     srand(time(NULL) + expNumber);
 
     log_debug("Initializing centroids randomly...");
-    double **centroids = malloc(k * sizeof(double *));
+    // centroids share the row layout of the dataframe
+    double *centroids = allocMatrix(k, df->stride);
 
     for (int i = 0; i < k; i++)
     {
         int random_index = rand() % df->maxRows;
-        centroids[i] = malloc(df->numFeatures * sizeof(double));
+        double *row = dfRow(df, random_index);
         for (int j = 0; j < df->numFeatures; j++)
         {
-            centroids[i][j] = df->data[random_index][j];
+            centroids[i * df->stride + j] = row[j];
         }
     }
 
@@ -53,17 +55,20 @@ double **initCentroids(Dataframe *df, int k, int expNumber) {
     return centroids;
 }
 
-int *updateAssignments(Dataframe *df, double **centroids, int k, int *assignments) {
+int *updateAssignments(Dataframe *df, double *centroids, int k, int *assignments) {
     // assign each data point to the nearest centroid
     log_debug("Updating assignments...");
 
     for (int i = 0; i < df->maxRows; i++)
     {
+        const double *row = dfRow(df, i);
         double minDistance = INFINITY;
         int closestCentroid = -1;
         for (int j = 0; j < k; j++)
         {
-            double distance = euclideanDistance(df->data[i], centroids[j], df->numFeatures);
+            double distance = euclideanDistance(
+                row, centroids + j * df->stride, df->numFeatures
+            );
             if (distance < minDistance)
             {
                 minDistance = distance;
@@ -77,7 +82,7 @@ int *updateAssignments(Dataframe *df, double **centroids, int k, int *assignment
     return assignments;
 }
 
-void updateCentroids(Dataframe *df, double **centroids, int *assignments, int k) {
+void updateCentroids(Dataframe *df, double *centroids, int *assignments, int k) {
     log_debug("Updating centroids...");
 
     double **newCentroids = malloc(k * sizeof(double *));
@@ -88,10 +93,11 @@ void updateCentroids(Dataframe *df, double **centroids, int *assignments, int k)
 
     // Sum up data points assigned to each centroid
     for (int i = 0; i < df->maxRows; i++) {
+        const double *row = dfRow(df, i);
         int cluster = assignments[i];
         counts[cluster]++;
         for (int j = 0; j < df->numFeatures; j++) {
-            newCentroids[cluster][j] += df->data[i][j];
+            newCentroids[cluster][j] += row[j];
         }
     }
 
@@ -99,7 +105,7 @@ void updateCentroids(Dataframe *df, double **centroids, int *assignments, int k)
     for (int i = 0; i < k; i++) {
         if (counts[i] > 0) {
             for (int j = 0; j < df->numFeatures; j++) {
-                centroids[i][j] = newCentroids[i][j] / counts[i];
+                centroids[i * df->stride + j] = newCentroids[i][j] / counts[i];
             }
         }
     }
@@ -115,15 +121,16 @@ void updateCentroids(Dataframe *df, double **centroids, int *assignments, int k)
 }
 
 int hasConverged(
-    double **currentCentroids,
-    double **prevCentroids,
+    double *currentCentroids,
+    double *prevCentroids,
     int k,
     int numFeatures,
+    int stride,
     double threshold
 ) {
     for (int i = 0; i < k; i++) {
         for (int j = 0; j < numFeatures; j++) {
-            if (fabs(currentCentroids[i][j] - prevCentroids[i][j]) > threshold) {
+            if (fabs(currentCentroids[i * stride + j] - prevCentroids[i * stride + j]) > threshold) {
                 return 0;
             }
         }
@@ -141,13 +148,8 @@ void kmeans(Dataframe *df, Experiment *exp, int k, int maxIter, int expNumber, i
 
     log_debug("Running k-means with k=%d and maxIter=%d...", k, maxIter);
 
-    double **centroids = initCentroids(df, k, expNumber);
-
-    // TODO: separate function to allocate memory for prevCentroids
-    double **prevCentroids = malloc(k * sizeof(double *));
-    for (int i = 0; i < k; i++) {
-        prevCentroids[i] = malloc(df->numFeatures * sizeof(double));
-    }
+    double *centroids = initCentroids(df, k, expNumber);
+    double *prevCentroids = allocMatrix(k, df->stride);
 
     int *assignments = malloc(df->maxRows * sizeof(int));
     int iteration = 0;
@@ -161,14 +163,12 @@ void kmeans(Dataframe *df, Experiment *exp, int k, int maxIter, int expNumber, i
         }
 
         // save previous centroids before updating
-        for (int i = 0; i < k; i++) {
-            for (int j = 0; j < df->numFeatures; j++) {
-                prevCentroids[i][j] = centroids[i][j];
-            }
-        }
+        memcpy(prevCentroids, centroids, (size_t)k * df->stride * sizeof(double));
         updateCentroids(df, centroids, assignments, k);
 
-        if (hasConverged(centroids, prevCentroids, k, df->numFeatures, CONVERGENCE_THRESHOLD)) {
+        if (hasConverged(
+            centroids, prevCentroids, k, df->numFeatures, df->stride, CONVERGENCE_THRESHOLD
+        )) {
             log_debug("Convergence achieved after %d iterations.", iteration + 1);
             break;
         }
@@ -184,10 +184,8 @@ void kmeans(Dataframe *df, Experiment *exp, int k, int maxIter, int expNumber, i
     exp->executionTime = wall_time_used;
     exp->number = expNumber;
 
-    for (int i = 0; i < k; i++) {
-        free(centroids[i]);
-    }
     free(centroids);
+    free(prevCentroids);
     free(assignments);
 
     log_debug("K-means completed!");
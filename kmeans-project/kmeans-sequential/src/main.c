@@ -74,13 +74,8 @@ int main(int argc, char *argv[])
     }
 
     log_debug("Freeing memory...");
-    for (int i = 0; i < df.maxRows; i++)
-    {
-        if (df.data[i] != NULL)
-        {
-            free(df.data[i]);
-        }
-    }
+    freeDataframe(&df);
+    free(experiments);
 
     return 0;
 }